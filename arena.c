@@ -0,0 +1,312 @@
+#include "arena.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <gmp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+//GMP memory functions backed by per-thread bump arenas.
+//
+//Between arena_begin() and arena_end() every GMP allocation made by the thread is cut
+//from its arena, freeing it does nothing, and arena_end() releases everything allocated
+//since the matching arena_begin() at once. Outside a scope, or while paused, GMP memory
+//comes from malloc() as before. Each block starts with a header holding its size and the
+//scope depth it was cut at (0 for the heap), so blocks may be freed or resized by any thread.
+//
+//An mpz_t that outlives a scope must have its memory before the scope begins, or be
+//written with the arena paused, since GMP allocates on the first write to a new mpz_t.
+//Resizing a block from an outer scope moves it to the heap, never into the inner scope.
+
+typedef struct chunk {
+    struct chunk *prev;
+    size_t size;
+    size_t used;
+} chunk_t;
+
+typedef struct {
+    size_t size;
+    size_t depth;
+} block_t;
+
+typedef struct {
+    chunk_t *head;
+    chunk_t *spare;
+    uint32_t depth;
+    uint32_t paused;
+    size_t live;
+    size_t peak;
+    uint64_t arena_allocs;
+    uint64_t heap_allocs;
+    bool registered;
+} arena_t;
+
+//Rounds n up to a multiple of 16 bytes, the alignment of every block.
+#define ALIGN16(n) (((n) + 15) & ~(size_t) 15)
+
+//Bytes before the first block of a chunk.
+#define CHUNK_HEADER ALIGN16(sizeof(chunk_t))
+
+static _Thread_local arena_t arena;
+
+//Counts of every thread, added to when a thread leaves its outermost scope or exits.
+static atomic_uint_fast64_t total_arena_allocs;
+static atomic_uint_fast64_t total_heap_allocs;
+static atomic_uint_fast64_t total_peak_bytes;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+//Adds the counts of the calling thread to the totals.
+//Returns nothing (void).
+//
+//a: the thread's arena.
+static void flush(arena_t *a) {
+    atomic_fetch_add(&total_arena_allocs, a->arena_allocs);
+    atomic_fetch_add(&total_heap_allocs, a->heap_allocs);
+    a->arena_allocs = 0;
+    a->heap_allocs = 0;
+
+    uint_fast64_t peak = atomic_load(&total_peak_bytes);
+    while (a->peak > peak && !atomic_compare_exchange_weak(&total_peak_bytes, &peak, a->peak)) {
+    }
+}
+
+//Frees the chunks of a thread's arena when the thread exits.
+//Returns nothing (void).
+//
+//arg: the thread's arena.
+static void destroy(void *arg) {
+    arena_t *a = (arena_t *) arg;
+    flush(a);
+    while (a->head != NULL) {
+        chunk_t *prev = a->head->prev;
+        free(a->head);
+        a->head = prev;
+    }
+    free(a->spare);
+    a->spare = NULL;
+}
+
+//Creates the key whose destructor frees a thread's arena.
+//Returns nothing (void).
+static void make_key(void) {
+    pthread_key_create(&key, destroy);
+}
+
+//Registers the calling thread's arena to be freed when the thread exits.
+//Returns nothing (void).
+static void attach(void) {
+    if (!arena.registered) {
+        pthread_once(&key_once, make_key);
+        pthread_setspecific(key, &arena);
+        arena.registered = true;
+    }
+}
+
+//Allocates a block on the heap. Like GMP's own allocator, stops the program if out of memory.
+//Returns the usable memory of the block.
+//
+//size: usable bytes.
+static void *heap_alloc(size_t size) {
+    block_t *b = (block_t *) malloc(sizeof(block_t) + size);
+    if (b == NULL) {
+        fprintf(stderr, "GNU MP: Cannot allocate memory (size=%zu)\n", size);
+        abort();
+    }
+    b->size = size;
+    b->depth = 0;
+    arena.heap_allocs += 1;
+    return b + 1;
+}
+
+//Starts a new chunk with room for need bytes, reusing the spare chunk if it is big enough.
+//Returns false if no memory could be allocated.
+//
+//need: bytes the next block takes, including its header.
+static bool grow(size_t need) {
+    chunk_t *c = arena.spare;
+    if (c != NULL && c->size >= need) {
+        arena.spare = NULL;
+    } else {
+        size_t size = (need > ARENA_CHUNK_BYTES) ? need : ARENA_CHUNK_BYTES;
+        c = (chunk_t *) malloc(CHUNK_HEADER + size);
+        if (c == NULL) {
+            return false;
+        }
+        c->size = size;
+    }
+    c->used = 0;
+    c->prev = arena.head;
+    arena.head = c;
+    return true;
+}
+
+//Allocates GMP memory from the arena inside a scope, or from the heap outside one.
+//Returns the allocated memory.
+//
+//size: bytes needed.
+static void *arena_alloc(size_t size) {
+    attach();
+    if (arena.depth == 0 || arena.paused > 0) {
+        return heap_alloc(size);
+    }
+
+    size_t need = sizeof(block_t) + ALIGN16(size);
+    if ((arena.head == NULL || arena.head->size - arena.head->used < need) && !grow(need)) {
+        return heap_alloc(size);
+    }
+
+    block_t *b = (block_t *) ((uint8_t *) arena.head + CHUNK_HEADER + arena.head->used);
+    arena.head->used += need;
+    arena.live += need;
+    if (arena.live > arena.peak) {
+        arena.peak = arena.live;
+    }
+    arena.arena_allocs += 1;
+    b->size = size;
+    b->depth = arena.depth;
+    return b + 1;
+}
+
+//Resizes GMP memory. Heap blocks stay on the heap. Arena blocks of the current scope
+//grow in place when they are the last block, and everything else moves to the heap.
+//Returns the resized memory.
+//
+//ptr: memory from arena_alloc() or arena_realloc().
+//old_size: unused, the size is kept in the block header.
+//new_size: bytes needed.
+static void *arena_realloc(void *ptr, size_t old_size, size_t new_size) {
+    (void) old_size;
+    block_t *b = (block_t *) ptr - 1;
+
+    if (b->depth == 0) {
+        b = (block_t *) realloc(b, sizeof(block_t) + new_size);
+        if (b == NULL) {
+            fprintf(stderr, "GNU MP: Cannot reallocate memory (new_size=%zu)\n", new_size);
+            abort();
+        }
+        b->size = new_size;
+        arena.heap_allocs += 1;
+        return b + 1;
+    }
+
+    //shrinking never needs new memory
+    if (new_size <= b->size) {
+        return ptr;
+    }
+
+    void *moved;
+    if (b->depth == arena.depth && arena.paused == 0) {
+        chunk_t *c = arena.head;
+        uint8_t *end = (uint8_t *) ptr + ALIGN16(b->size);
+        if (c != NULL && end == (uint8_t *) c + CHUNK_HEADER + c->used
+            && ALIGN16(new_size) - ALIGN16(b->size) <= c->size - c->used) {
+            //the last block of the chunk, so it grows where it is
+            size_t extra = ALIGN16(new_size) - ALIGN16(b->size);
+            c->used += extra;
+            arena.live += extra;
+            arena.peak = (arena.live > arena.peak) ? arena.live : arena.peak;
+            b->size = new_size;
+            return ptr;
+        }
+        moved = arena_alloc(new_size);
+    } else {
+        moved = heap_alloc(new_size);
+    }
+    memcpy(moved, ptr, (b->size < new_size) ? b->size : new_size);
+    return moved;
+}
+
+//Frees GMP memory. Arena blocks are released by arena_end() instead.
+//Returns nothing (void).
+//
+//ptr: memory from arena_alloc() or arena_realloc().
+//size: unused, the size is kept in the block header.
+static void arena_free(void *ptr, size_t size) {
+    (void) size;
+    block_t *b = (block_t *) ptr - 1;
+    if (b->depth == 0) {
+        free(b);
+    }
+}
+
+//Makes GMP allocate through the arenas. Must be called before any mpz_t is initialized.
+//Returns nothing (void).
+void arena_install(void) {
+    mp_set_memory_functions(arena_alloc, arena_realloc, arena_free);
+}
+
+//Begins a scope: until the matching arena_end(), GMP memory of the calling thread
+//comes from its arena. Scopes nest.
+//Returns the mark to pass to arena_end().
+arena_mark_t arena_begin(void) {
+    arena_mark_t mark = { arena.head, (arena.head != NULL) ? arena.head->used : 0, arena.live, arena.depth };
+    arena.depth += 1;
+    return mark;
+}
+
+//Ends a scope, releasing all arena memory allocated since it began.
+//Returns nothing (void).
+//
+//mark: the value arena_begin() returned.
+void arena_end(arena_mark_t mark) {
+    while (arena.head != (chunk_t *) mark.chunk) {
+        chunk_t *c = arena.head;
+        arena.head = c->prev;
+        //the largest chunk is kept for the next scope
+        if (arena.spare == NULL || arena.spare->size < c->size) {
+            free(arena.spare);
+            arena.spare = c;
+        } else {
+            free(c);
+        }
+    }
+    if (arena.head != NULL) {
+        arena.head->used = mark.used;
+    }
+    arena.live = mark.live;
+    arena.depth = mark.depth;
+    if (arena.depth == 0) {
+        flush(&arena);
+    }
+}
+
+//Sends the calling thread's GMP allocations to the heap until arena_resume(), so results
+//written to mpz_t variables from outside the current scope survive arena_end().
+//Returns nothing (void).
+void arena_pause(void) {
+    arena.paused += 1;
+}
+
+//Undoes one arena_pause().
+//Returns nothing (void).
+void arena_resume(void) {
+    arena.paused -= 1;
+}
+
+//Reads the allocation counts of all threads that have left their outermost scope or exited,
+//and of the calling thread.
+//Returns nothing (void).
+//
+//stats: stores the number of arena and heap allocations, and the most arena memory one thread used.
+void arena_stats(arena_stats_t *stats) {
+    flush(&arena);
+    stats->arena_allocs = atomic_load(&total_arena_allocs);
+    stats->heap_allocs = atomic_load(&total_heap_allocs);
+    stats->peak_bytes = atomic_load(&total_peak_bytes);
+}
+
+//Prints the allocation counts for verbose output.
+//Returns nothing (void).
+//
+//file: where to print.
+void arena_print_stats(FILE *file) {
+    arena_stats_t stats;
+    arena_stats(&stats);
+    fprintf(file, "allocations = %" PRIu64 " arena, %" PRIu64 " heap, %" PRIu64 " peak arena bytes\n",
+        stats.arena_allocs, stats.heap_allocs, stats.peak_bytes);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//Bytes reserved at a time for a thread's arena (256 KiB).
+#define ARENA_CHUNK_BYTES (1 << 18)
+
+//Position of a thread's arena, saved when a scope begins.
+typedef struct {
+    void *chunk;
+    size_t used;
+    size_t live;
+    uint32_t depth;
+} arena_mark_t;
+
+typedef struct {
+    uint64_t arena_allocs;
+    uint64_t heap_allocs;
+    uint64_t peak_bytes;
+} arena_stats_t;
+
+void arena_install(void);
+
+arena_mark_t arena_begin(void);
+
+void arena_end(arena_mark_t mark);
+
+void arena_pause(void);
+
+void arena_resume(void);
+
+void arena_stats(arena_stats_t *stats);
+
+void arena_print_stats(FILE *file);
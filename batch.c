@@ -0,0 +1,203 @@
+#include "batch.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+//Initializes an empty file list.
+//Returns nothing (void).
+//
+//list: the list to initialize.
+void filelist_init(filelist_t *list) {
+    list->paths = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+//Adds a copy of path to the list.
+//Returns false if memory ran out.
+//
+//list: an initialized list.
+//path: path to add.
+bool filelist_add(filelist_t *list, const char *path) {
+    if (list->count == list->capacity) {
+        size_t capacity = (list->capacity == 0) ? 64 : 2 * list->capacity;
+        char **paths = (char **) realloc(list->paths, capacity * sizeof(char *));
+        if (paths == NULL) {
+            return false;
+        }
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    list->paths[list->count] = strdup(path);
+    if (list->paths[list->count] == NULL) {
+        return false;
+    }
+    list->count += 1;
+    return true;
+}
+
+//Adds every non-empty line of a list file to the list.
+//Returns false if the list file could not be read.
+//
+//list: an initialized list.
+//listname: path of a file with one path per line.
+bool filelist_read(filelist_t *list, const char *listname) {
+    FILE *listfile = fopen(listname, "r");
+    if (listfile == NULL) {
+        fprintf(stderr, "%s: No such file or directory\n", listname);
+        return false;
+    }
+
+    bool ok = true;
+    char line[4096];
+    while (ok && fgets(line, sizeof(line), listfile) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0') {
+            ok = filelist_add(list, line);
+        }
+    }
+    fclose(listfile);
+    return ok;
+}
+
+//Adds every regular file below a directory to the list, in name order per directory.
+//Returns false if a directory could not be read.
+//
+//list: an initialized list.
+//dirname: directory to walk.
+bool filelist_walk(filelist_t *list, const char *dirname) {
+    struct dirent **entries;
+    int count = scandir(dirname, &entries, NULL, alphasort);
+    if (count < 0) {
+        fprintf(stderr, "%s: No such file or directory\n", dirname);
+        return false;
+    }
+
+    bool ok = true;
+    char path[4096];
+    for (int i = 0; i < count; i += 1) {
+        char *name = entries[i]->d_name;
+        struct stat st;
+
+        if (ok && strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+            snprintf(path, sizeof(path), "%s/%s", dirname, name);
+            if (stat(path, &st) != 0) {
+                fprintf(stderr, "%s: No such file or directory\n", path);
+            } else if (S_ISDIR(st.st_mode)) {
+                ok = filelist_walk(list, path);
+            } else if (S_ISREG(st.st_mode)) {
+                ok = filelist_add(list, path);
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return ok;
+}
+
+//Filters the paths from index first on by suffix, so a walk can keep only the files a
+//batch reads, or leave out the outputs of an earlier run.
+//Returns nothing (void).
+//
+//list: an initialized list.
+//first: index of the first path to filter, such as the first one a walk added.
+//suffix: the suffix to match.
+//keep: keeps the paths ending in suffix if true, else keeps the others.
+void filelist_filter_suffix(filelist_t *list, size_t first, const char *suffix, bool keep) {
+    size_t slen = strlen(suffix);
+    size_t kept = first;
+
+    for (size_t i = first; i < list->count; i += 1) {
+        size_t len = strlen(list->paths[i]);
+        bool match = len > slen && strcmp(list->paths[i] + len - slen, suffix) == 0;
+        if (match == keep) {
+            list->paths[kept] = list->paths[i];
+            kept += 1;
+        } else {
+            free(list->paths[i]);
+        }
+    }
+    list->count = kept;
+}
+
+//Frees the paths of a list.
+//Returns nothing (void).
+//
+//list: an initialized list.
+void filelist_clear(filelist_t *list) {
+    for (size_t i = 0; i < list->count; i += 1) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    filelist_init(list);
+}
+
+//Work shared by the batch worker threads.
+typedef struct {
+    filelist_t *list;
+    batch_fn_t fn;
+    void *arg;
+    atomic_size_t next;
+    atomic_uint_fast64_t failed;
+} pool_t;
+
+//Takes files from the list one at a time until none are left.
+//Returns NULL.
+//
+//arg: pointer to the shared pool_t.
+static void *batch_worker(void *arg) {
+    pool_t *pool = (pool_t *) arg;
+
+    size_t i;
+    while ((i = atomic_fetch_add(&pool->next, 1)) < pool->list->count) {
+        if (!pool->fn(pool->list->paths[i], pool->arg)) {
+            atomic_fetch_add(&pool->failed, 1);
+        }
+    }
+    return NULL;
+}
+
+//Calls fn on every file in the list using a pool of worker threads.
+//Returns the number of files fn failed on.
+//
+//list: an initialized list.
+//threads: number of worker threads (at least 1).
+//fn: function called once per file. It may be called from several threads at once.
+//arg: passed to fn.
+uint64_t batch_run(filelist_t *list, uint32_t threads, batch_fn_t fn, void *arg) {
+    pool_t pool;
+    pool.list = list;
+    pool.fn = fn;
+    pool.arg = arg;
+    atomic_init(&pool.next, 0);
+    atomic_init(&pool.failed, 0);
+
+    if (threads == 0) {
+        threads = 1;
+    }
+    if (threads > list->count) {
+        threads = (list->count == 0) ? 1 : (uint32_t) list->count;
+    }
+
+    //the calling thread works too
+    pthread_t *workers = (pthread_t *) calloc(threads, sizeof(pthread_t));
+    uint32_t started = 0;
+    for (uint32_t i = 1; workers != NULL && i < threads; i += 1) {
+        if (pthread_create(&workers[started], NULL, batch_worker, &pool) == 0) {
+            started += 1;
+        }
+    }
+    batch_worker(&pool);
+    for (uint32_t i = 0; i < started; i += 1) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    return atomic_load(&pool.failed);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//A growing list of input file paths.
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t capacity;
+} filelist_t;
+
+//Processes one file of a batch. Returns false if the file failed.
+typedef bool (*batch_fn_t)(const char *path, void *arg);
+
+void filelist_init(filelist_t *list);
+
+bool filelist_add(filelist_t *list, const char *path);
+
+bool filelist_read(filelist_t *list, const char *listname);
+
+bool filelist_walk(filelist_t *list, const char *dirname);
+
+void filelist_filter_suffix(filelist_t *list, size_t first, const char *suffix, bool keep);
+
+void filelist_clear(filelist_t *list);
+
+uint64_t batch_run(filelist_t *list, uint32_t threads, batch_fn_t fn, void *arg);
@@ -0,0 +1,258 @@
+#include "batchgcd.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+//Bernstein's batch GCD: the product P of all moduli is reduced down a remainder tree so
+//that each n ends up with P mod n^2, and gcd(n, (P mod n^2) / n) is the gcd of n with the
+//product of every other modulus.
+//
+//A tree over all moduli takes memory for every one of its levels, so the moduli are split
+//into groups. The upper tree, over the group roots R, is built and reduced by one thread,
+//so only one reduction of full-size numbers is live at a time, and leaves P mod R^2 for
+//every group. The lower trees, one per group, are then built and descended in parallel.
+
+//Levels of one tree, enough for any tree that fits in memory.
+#define TREE_DEPTH 64
+
+//Work shared by the batch GCD worker threads.
+typedef struct {
+    mpz_t *g;
+    mpz_t *n;
+    size_t count;
+    size_t group;
+    mpz_t *roots;
+    bool scan;
+    atomic_size_t next;
+} job_t;
+
+//Multiplies count numbers in a balanced tree, so the operands of each product are of
+//about the same size.
+//Returns nothing (void).
+//
+//out: initialized mpz_t that stores the product.
+//n: the numbers.
+//count: number of numbers, at least 1.
+static void product(mpz_t out, mpz_t n[], size_t count) {
+    if (count == 1) {
+        mpz_set(out, n[0]);
+        return;
+    }
+    mpz_t right;
+    mpz_init(right);
+    product(out, n, count / 2);
+    product(right, n + count / 2, count - count / 2);
+    mpz_mul(out, out, right);
+    mpz_clear(right);
+}
+
+//Finds gcd(n, P / n) for every modulus n of one group.
+//Returns nothing (void).
+//
+//job: the shared work, with P mod R^2 in the group's entry of roots.
+//index: index of the group.
+//first: index of the group's first modulus.
+//count: number of moduli in the group.
+static void scan_group(job_t *job, size_t index, size_t first, size_t count) {
+    mpz_t *levels[TREE_DEPTH];
+    size_t counts[TREE_DEPTH];
+    size_t depth = 1;
+    mpz_t square;
+    mpz_init(square);
+
+    //product tree of the group, with the moduli as its lowest level, up to the two halves of R
+    levels[0] = job->n + first;
+    counts[0] = count;
+    while (counts[depth - 1] > 2) {
+        mpz_t *below = levels[depth - 1];
+        counts[depth] = (counts[depth - 1] + 1) / 2;
+        levels[depth] = (mpz_t *) malloc(counts[depth] * sizeof(mpz_t));
+        for (size_t i = 0; i < counts[depth]; i += 1) {
+            mpz_init(levels[depth][i]);
+            if (2 * i + 1 < counts[depth - 1]) {
+                mpz_mul(levels[depth][i], below[2 * i], below[2 * i + 1]);
+            } else {
+                mpz_set(levels[depth][i], below[2 * i]);
+            }
+        }
+        depth += 1;
+    }
+
+    //remainder tree, from P mod R^2 down to P mod n^2 at each modulus
+    mpz_t *rems = (mpz_t *) malloc(sizeof(mpz_t));
+    size_t above = 1;
+    mpz_init(rems[0]);
+    mpz_swap(rems[0], job->roots[index]);
+    for (size_t l = depth; l-- > 0;) {
+        //a group of one modulus is its own root
+        if (counts[l] == 1) {
+            continue;
+        }
+        mpz_t *below = (mpz_t *) malloc(counts[l] * sizeof(mpz_t));
+        for (size_t i = 0; i < counts[l]; i += 1) {
+            mpz_init(below[i]);
+            mpz_mul(square, levels[l][i], levels[l][i]);
+            mpz_mod(below[i], rems[i / 2], square);
+        }
+        for (size_t i = 0; i < above; i += 1) {
+            mpz_clear(rems[i]);
+        }
+        if (l + 1 < depth) {
+            for (size_t i = 0; i < counts[l + 1]; i += 1) {
+                mpz_clear(levels[l + 1][i]);
+            }
+            free(levels[l + 1]);
+        }
+        free(rems);
+        rems = below;
+        above = counts[l];
+    }
+
+    //P mod n^2 is n times (P / n mod n)
+    for (size_t i = 0; i < count; i += 1) {
+        mpz_divexact(rems[i], rems[i], levels[0][i]);
+        mpz_gcd(job->g[first + i], rems[i], levels[0][i]);
+        mpz_clear(rems[i]);
+    }
+    free(rems);
+    mpz_clear(square);
+}
+
+//Reduces P down a remainder tree over the group roots, one level at a time on one thread.
+//Returns nothing (void).
+//
+//roots: the group roots R, each replaced with P mod R^2.
+//groups: number of groups.
+static void reduce_roots(mpz_t roots[], size_t groups) {
+    mpz_t *levels[TREE_DEPTH];
+    size_t counts[TREE_DEPTH];
+    size_t depth = 1;
+
+    //product tree of the roots, up to P
+    levels[0] = roots;
+    counts[0] = groups;
+    while (counts[depth - 1] > 1) {
+        mpz_t *below = levels[depth - 1];
+        counts[depth] = (counts[depth - 1] + 1) / 2;
+        levels[depth] = (mpz_t *) malloc(counts[depth] * sizeof(mpz_t));
+        for (size_t i = 0; i < counts[depth]; i += 1) {
+            mpz_init(levels[depth][i]);
+            if (2 * i + 1 < counts[depth - 1]) {
+                mpz_mul(levels[depth][i], below[2 * i], below[2 * i + 1]);
+            } else {
+                mpz_set(levels[depth][i], below[2 * i]);
+            }
+        }
+        depth += 1;
+    }
+
+    //P mod X^2 for every node X, each level replacing the one above it. With a single
+    //group P is its root R, and P mod R^2 = R is already in place.
+    mpz_t square;
+    mpz_init(square);
+    for (size_t l = depth - 1; l-- > 0;) {
+        for (size_t i = 0; i < counts[l]; i += 1) {
+            mpz_mul(square, levels[l][i], levels[l][i]);
+            mpz_mod(levels[l][i], levels[l + 1][i / 2], square);
+        }
+        for (size_t i = 0; i < counts[l + 1]; i += 1) {
+            mpz_clear(levels[l + 1][i]);
+        }
+        free(levels[l + 1]);
+    }
+    mpz_clear(square);
+}
+
+//Takes groups one at a time until none are left, finding their roots or scanning them.
+//Returns NULL.
+//
+//arg: pointer to the shared job_t.
+static void *gcd_worker(void *arg) {
+    job_t *job = (job_t *) arg;
+
+    size_t i;
+    while ((i = atomic_fetch_add(&job->next, 1)) * job->group < job->count) {
+        size_t first = i * job->group;
+        size_t count = (job->count - first < job->group) ? job->count - first : job->group;
+        if (job->scan) {
+            scan_group(job, i, first, count);
+        } else {
+            product(job->roots[i], job->n + first, count);
+        }
+    }
+    return NULL;
+}
+
+//Runs the workers of one pass over every group, the calling thread included.
+//Returns nothing (void).
+//
+//job: the shared work.
+//scan: scans the groups if true, else finds their roots.
+//threads: number of threads (at least 1).
+static void run_pass(job_t *job, bool scan, uint32_t threads) {
+    job->scan = scan;
+    atomic_store(&job->next, 0);
+    pthread_t *workers = (pthread_t *) calloc(threads, sizeof(pthread_t));
+    uint32_t started = 0;
+    for (uint32_t i = 1; workers != NULL && i < threads; i += 1) {
+        if (pthread_create(&workers[started], NULL, gcd_worker, job) == 0) {
+            started += 1;
+        }
+    }
+    gcd_worker(job);
+    for (uint32_t i = 0; i < started; i += 1) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+}
+
+//Finds the gcd of each modulus with the product of all the others, in quasi-linear time.
+//A result other than 1 means the modulus shares a factor with another one, and a result
+//equal to the modulus means all of its factors are shared, or it appears more than once.
+//Memory holds the tree over the group roots, about the size of P per level, while it is
+//reduced, then P mod R^2 for every group and one group tree per thread.
+//Returns nothing (void).
+//
+//g: initialized mpz_t values that store the gcd of each modulus.
+//n: the moduli, each greater than 1.
+//count: number of moduli.
+//group: moduli in one remainder tree, or 0 for BATCH_GCD_GROUP.
+//threads: number of groups worked on at once.
+void batch_gcd(mpz_t g[], mpz_t n[], size_t count, size_t group, uint32_t threads) {
+    if (count == 0) {
+        return;
+    }
+    group = (group == 0) ? BATCH_GCD_GROUP : group;
+    size_t groups = (count + group - 1) / group;
+    if (threads == 0) {
+        threads = 1;
+    }
+    if (threads > groups) {
+        threads = (uint32_t) groups;
+    }
+
+    job_t job;
+    job.g = g;
+    job.n = n;
+    job.count = count;
+    job.group = group;
+    job.roots = (mpz_t *) malloc(groups * sizeof(mpz_t));
+    atomic_init(&job.next, 0);
+    for (size_t i = 0; i < groups; i += 1) {
+        mpz_init(job.roots[i]);
+    }
+
+    //the root of every group, then P mod R^2 for each of them
+    run_pass(&job, false, threads);
+    reduce_roots(job.roots, groups);
+
+    run_pass(&job, true, threads);
+    for (size_t i = 0; i < groups; i += 1) {
+        mpz_clear(job.roots[i]);
+    }
+    free(job.roots);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <gmp.h>
+
+//Moduli in one remainder tree when no group size is given.
+#define BATCH_GCD_GROUP (1 << 14)
+
+void batch_gcd(mpz_t g[], mpz_t n[], size_t count, size_t group, uint32_t threads);
@@ -0,0 +1,79 @@
+#include "chacha.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//The ChaCha20 block function (Bernstein, 2008) with a 64 bit block counter and a
+//64 bit nonce, as in the original ChaCha design.
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define QUARTER(a, b, c, d)                                                                        \
+    do {                                                                                           \
+        a += b;                                                                                    \
+        d ^= a;                                                                                    \
+        d = ROTL(d, 16);                                                                           \
+        c += d;                                                                                    \
+        b ^= c;                                                                                    \
+        b = ROTL(b, 12);                                                                           \
+        a += b;                                                                                    \
+        d ^= a;                                                                                    \
+        d = ROTL(d, 8);                                                                            \
+        c += d;                                                                                    \
+        b ^= c;                                                                                    \
+        b = ROTL(b, 7);                                                                            \
+    } while (0)
+
+//Computes one 64 byte ChaCha20 keystream block as 16 words.
+//Returns nothing (void).
+//
+//out: array of CHACHA_BLOCK_WORDS words to store the block in.
+//key: array of CHACHA_KEY_WORDS key words.
+//counter: index of the block in the stream.
+//nonce: selects one of 2^64 independent streams for the key.
+void chacha_block(uint32_t out[], const uint32_t key[], uint64_t counter, uint64_t nonce) {
+    uint32_t in[CHACHA_BLOCK_WORDS] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, key[0],
+        key[1], key[2], key[3], key[4], key[5], key[6], key[7], (uint32_t) counter,
+        (uint32_t) (counter >> 32), (uint32_t) nonce, (uint32_t) (nonce >> 32) };
+    uint32_t x[CHACHA_BLOCK_WORDS];
+
+    for (uint32_t i = 0; i < CHACHA_BLOCK_WORDS; i += 1) {
+        x[i] = in[i];
+    }
+
+    //20 rounds as 10 column and diagonal double rounds
+    for (uint32_t i = 0; i < 10; i += 1) {
+        QUARTER(x[0], x[4], x[8], x[12]);
+        QUARTER(x[1], x[5], x[9], x[13]);
+        QUARTER(x[2], x[6], x[10], x[14]);
+        QUARTER(x[3], x[7], x[11], x[15]);
+        QUARTER(x[0], x[5], x[10], x[15]);
+        QUARTER(x[1], x[6], x[11], x[12]);
+        QUARTER(x[2], x[7], x[8], x[13]);
+        QUARTER(x[3], x[4], x[9], x[14]);
+    }
+
+    for (uint32_t i = 0; i < CHACHA_BLOCK_WORDS; i += 1) {
+        out[i] = x[i] + in[i];
+    }
+}
+
+//Encrypts or decrypts data in place by XOR with the ChaCha20 keystream.
+//Returns nothing (void).
+//
+//data: bytes to transform.
+//len: number of bytes.
+//key: array of CHACHA_KEY_WORDS key words.
+//counter: index of the keystream block data starts at.
+//nonce: selects one of 2^64 independent streams for the key.
+void chacha_xor(uint8_t *data, size_t len, const uint32_t key[], uint64_t counter, uint64_t nonce) {
+    uint32_t block[CHACHA_BLOCK_WORDS];
+
+    for (size_t i = 0; i < len; i += 4 * CHACHA_BLOCK_WORDS) {
+        chacha_block(block, key, counter, nonce);
+        counter += 1;
+        //the keystream bytes are the block words in little-endian order
+        for (size_t j = 0; j < 4 * CHACHA_BLOCK_WORDS && i + j < len; j += 1) {
+            data[i + j] ^= (uint8_t) (block[j / 4] >> (8 * (j % 4)));
+        }
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHACHA_KEY_WORDS   8
+#define CHACHA_BLOCK_WORDS 16
+
+void chacha_block(uint32_t out[], const uint32_t key[], uint64_t counter, uint64_t nonce);
+
+void chacha_xor(uint8_t *data, size_t len, const uint32_t key[], uint64_t counter, uint64_t nonce);
@@ -0,0 +1,137 @@
+#include "checkpoint.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "sha256.h"
+#include "hex.h"
+
+//A checkpoint is a text file next to the output, replaced as a whole each time it is taken:
+//    mode key in_offset blocks out_len sha256 in_sha256
+//The output is written in whole lines or blocks, and a checkpoint is only taken between
+//them, so the first out_len bytes of the output are always complete and valid. in_sha256
+//identifies the input consumed, hashed the way the run reads it.
+
+//Saves the progress of a run, after making sure the output it covers is on disk.
+//Returns false if the output or the checkpoint could not be written.
+//
+//c: the progress, whose digests are set from hash and in_hash.
+//hash: SHA-256 of the first c->out_len bytes of output, which is left unfinished.
+//in_hash: SHA-256 of the input consumed, which is left unfinished.
+//outfile: the output file.
+//path: checkpoint file to write.
+bool checkpoint_take(checkpoint_t *c, sha256_t *hash, sha256_t *in_hash, FILE *outfile, const char *path) {
+    sha256_t copy = *hash;
+    sha256_final(&copy, c->digest);
+    copy = *in_hash;
+    sha256_final(&copy, c->in_digest);
+
+    //the output must be on disk before a checkpoint that covers it
+    if (fflush(outfile) != 0 || fsync(fileno(outfile)) != 0) {
+        return false;
+    }
+
+    char tmpname[4096];
+    char digest[2 * SHA256_DIGEST_BYTES + 1];
+    char in_digest[2 * SHA256_DIGEST_BYTES + 1];
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", path);
+    hex_encode(digest, c->digest, SHA256_DIGEST_BYTES);
+    digest[2 * SHA256_DIGEST_BYTES] = '\0';
+    hex_encode(in_digest, c->in_digest, SHA256_DIGEST_BYTES);
+    in_digest[2 * SHA256_DIGEST_BYTES] = '\0';
+
+    FILE *file = fopen(tmpname, "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "# rsa checkpoint\n# mode key in_offset blocks out_len sha256 in_sha256\n");
+    fprintf(file, "%s %s %" PRIu64 " %" PRIu64 " %" PRIu64 " %s %s\n", c->mode, c->key, c->in_offset,
+        c->blocks, c->out_len, digest, in_digest);
+    bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+
+    //renaming replaces the old checkpoint at once, so a crash leaves one or the other
+    return ok && rename(tmpname, path) == 0;
+}
+
+//Loads the checkpoint of an earlier run.
+//Returns 1 if a checkpoint was loaded, 0 if there is none, -1 if it is invalid.
+//
+//c: stores the progress.
+//path: checkpoint file to read.
+int checkpoint_load(checkpoint_t *c, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    int found = -1;
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char digest[2 * SHA256_DIGEST_BYTES + 2];
+        char in_digest[2 * SHA256_DIGEST_BYTES + 2];
+        if (line[0] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%7s %64s %" SCNu64 " %" SCNu64 " %" SCNu64 " %65s %65s", c->mode, c->key, &c->in_offset,
+                &c->blocks, &c->out_len, digest, in_digest)
+                == 7
+            && strlen(digest) == 2 * SHA256_DIGEST_BYTES && hex_decode(c->digest, digest, SHA256_DIGEST_BYTES)
+            && strlen(in_digest) == 2 * SHA256_DIGEST_BYTES
+            && hex_decode(c->in_digest, in_digest, SHA256_DIGEST_BYTES)) {
+            found = 1;
+        }
+        break;
+    }
+    fclose(file);
+    return found;
+}
+
+//Moves a run back to a checkpoint: checks the output against it, cuts off anything written
+//after it, and seeks the input to where it was. Nothing may have been read from infile yet.
+//Returns false if the output does not match the checkpoint or a file cannot be seeked.
+//
+//c: the loaded checkpoint.
+//infile: the input file, which must be seekable.
+//outfile: the output file, open for reading and writing.
+//hash: initialized SHA-256 context that stores the hash of the output kept.
+bool checkpoint_restore(checkpoint_t *c, FILE *infile, FILE *outfile, sha256_t *hash) {
+    uint8_t *buf = (uint8_t *) malloc(HEX_BUFFER_BYTES);
+    if (buf == NULL || fseeko(outfile, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "Error: the output cannot be read back.\n");
+        free(buf);
+        return false;
+    }
+
+    //the output up to the checkpoint must be what the interrupted run wrote
+    uint64_t left = c->out_len;
+    while (left > 0) {
+        size_t want = (left < HEX_BUFFER_BYTES) ? (size_t) left : HEX_BUFFER_BYTES;
+        size_t got = fread(buf, sizeof(uint8_t), want, outfile);
+        sha256_update(hash, buf, got);
+        left -= got;
+        if (got < want) {
+            break;
+        }
+    }
+    free(buf);
+
+    uint8_t digest[SHA256_DIGEST_BYTES];
+    sha256_t copy = *hash;
+    sha256_final(&copy, digest);
+    if (left > 0 || memcmp(digest, c->digest, SHA256_DIGEST_BYTES) != 0) {
+        fprintf(stderr, "Error: the output does not match the checkpoint.\n");
+        return false;
+    }
+
+    //the input is seeked below stdio, which has not buffered any of it
+    if (fseeko(outfile, (off_t) c->out_len, SEEK_SET) != 0 || ftruncate(fileno(outfile), (off_t) c->out_len) != 0
+        || lseek(fileno(infile), (off_t) c->in_offset, SEEK_SET) != (off_t) c->in_offset) {
+        fprintf(stderr, "Error: the input or output cannot be seeked.\n");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "sha256.h"
+
+//Seconds between checkpoints of a long run.
+#define CHECKPOINT_SECONDS 10
+
+//Longest key id a checkpoint holds, in characters.
+#define CHECKPOINT_KEY_MAX 64
+
+//Progress of an encrypt or decrypt run: the input consumed and the output written so far,
+//with hashes of both so a resumed run can check it continues the same input and output.
+typedef struct {
+    char mode[8];
+    char key[CHECKPOINT_KEY_MAX + 1];
+    uint64_t in_offset;
+    uint64_t blocks;
+    uint64_t out_len;
+    uint8_t digest[SHA256_DIGEST_BYTES];
+    uint8_t in_digest[SHA256_DIGEST_BYTES];
+} checkpoint_t;
+
+bool checkpoint_take(checkpoint_t *c, sha256_t *hash, sha256_t *in_hash, FILE *outfile, const char *path);
+
+int checkpoint_load(checkpoint_t *c, const char *path);
+
+bool checkpoint_restore(checkpoint_t *c, FILE *infile, FILE *outfile, sha256_t *hash);
@@ -4,12 +4,17 @@
 #include <gmp.h>
 #include "randstate.h"
 #include <stdlib.h>
+#include <string.h>
 #include "numtheory.h"
 #include <inttypes.h>
 #include "rsa.h"
+#include "arena.h"
+#include "batch.h"
+#include "profile.h"
 #include <time.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <getopt.h>
 
 //Pseudocode for this file is given in the Assignment 5 doc.
 
@@ -22,15 +27,91 @@ void usage(char *val) {
     fprintf(stderr, "   Decrypts data using RSA decryption.\n");
     fprintf(stderr, "   Encrypted data is encrypted by the encrypt program.\n\n");
     fprintf(stderr, "USAGE\n");
-    fprintf(stderr, "   %s [OPTIONS]\n\n", val);
+    fprintf(stderr, "   %s [OPTIONS] [files...]\n\n", val);
     fprintf(stderr, "OPTIONS\n"
                     "   -h              Display program help and usage.\n"
                     "   -v              Display verbose program output.\n"
                     "   -i infile       Input file of data to decrypt (default: stdin).\n"
                     "   -o outfile      Output file for decrypted data (default: stdout).\n"
-                    "   -n pvfile       Private key file (default: rsa.priv).\n");
+                    "   -n pvfile       Private key file (default: rsa.priv).\n"
+                    "   -r              Write each record as soon as it is decrypted.\n"
+                    "   -l listfile     Decrypt every file listed in listfile, one per line.\n"
+                    "   -d dir          Decrypt every file below dir ending in the suffix.\n"
+                    "   -x suffix       Suffix removed from batch output names (default: .rsa).\n"
+                    "   -t threads      Files decrypted at once in batch mode (default: the tuning\n"
+                    "                   profile, or online CPUs).\n"
+                    "   --checkpoint    Save progress to outfile.ckpt every 10 seconds, so an\n"
+                    "                   interrupted run can be resumed. Needs -o.\n"
+                    "   --resume        Check the output against outfile.ckpt and continue from it.\n"
+                    "   --legacy        Accept ciphertext with no end-of-stream line, as written by\n"
+                    "                   older versions of encrypt. Truncation is not detected.\n"
+                    "\n"
+                    "   Files given as operands, with -l or with -d are decrypted in batch:\n"
+                    "   file.rsa is decrypted to file (other names get .out added)\n"
+                    "   with the key read only once.\n");
 }
 
+//Settings shared by every file of a batch.
+typedef struct {
+    mpz_ptr n;
+    mpz_ptr d;
+    bool verbose;
+    bool legacy;
+    char *suffix;
+} batch_t;
+
+//Decrypts one file of a batch to the file name without the batch suffix.
+//Returns true if the file was decrypted.
+//
+//path: file to decrypt.
+//arg: pointer to the batch_t settings.
+bool decrypt_one(const char *path, void *arg) {
+    batch_t *batch = (batch_t *) arg;
+    char outname[4096];
+    size_t len = strlen(path);
+    size_t slen = strlen(batch->suffix);
+
+    if (slen > 0 && len > slen && strcmp(path + len - slen, batch->suffix) == 0) {
+        snprintf(outname, sizeof(outname), "%.*s", (int) (len - slen), path);
+    } else {
+        snprintf(outname, sizeof(outname), "%s.out", path);
+    }
+
+    FILE *infile = fopen(path, "r");
+    if (infile == NULL) {
+        fprintf(stderr, "%s: No such file or directory\n", path);
+        return false;
+    }
+    FILE *outfile = fopen(outname, "wb");
+    if (outfile == NULL) {
+        fprintf(stderr, "%s: No such file or directory\n", outname);
+        fclose(infile);
+        return false;
+    }
+
+    bool ok = rsa_decrypt_file(infile, outfile, batch->n, batch->d, batch->legacy);
+    ok = !ferror(infile) && !ferror(outfile) && ok;
+    fclose(infile);
+    ok = (fclose(outfile) == 0) && ok;
+
+    if (batch->verbose) {
+        printf("%s -> %s\n", path, outname);
+    }
+    return ok;
+}
+
+//Options with only a long form.
+#define OPT_CHECKPOINT 256
+#define OPT_RESUME     257
+#define OPT_LEGACY     258
+
+static struct option long_options[] = {
+    { "checkpoint", no_argument, NULL, OPT_CHECKPOINT },
+    { "resume", no_argument, NULL, OPT_RESUME },
+    { "legacy", no_argument, NULL, OPT_LEGACY },
+    { NULL, 0, NULL, 0 },
+};
+
 //Parses command-line options, reads the private key file, and prints decrypted text to outfile.
 //Returns a 0 or 1 depending on succesful exit of program.
 //
@@ -40,20 +121,36 @@ int main(int argc, char **argv) {
 
     int64_t opt;
 
-    //set verbose to false
+    //set verbose and record mode to false
     bool verbose = false;
+    bool records = false;
+
+    //batch mode settings
+    filelist_t list;
+    filelist_init(&list);
+    bool batch = false;
+    char *suffix = ".rsa";
+    char *dirname = NULL;
+    uint32_t threads = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+    bool threads_set = false;
 
     //open files
     FILE *infile = stdin;
     FILE *outfile = stdout;
+    char *outname = NULL;
+    bool checkpoint = false;
+    bool resume = false;
+    bool legacy = false;
     FILE *pvfile = fopen("rsa.priv", "r");
 
     mpz_t d, e, n, s;
 
+    //GMP allocates through the arenas from here on
+    arena_install();
     mpz_inits(d, e, n, s, NULL);
 
     //parse command-line options
-    while ((opt = getopt(argc, argv, "i:o:n:vh")) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:o:n:l:d:x:t:rvh", long_options, NULL)) != -1) {
         switch (opt) {
         case 'i':
             infile = fopen(optarg, "r");
@@ -63,14 +160,13 @@ int main(int argc, char **argv) {
                 return EXIT_FAILURE;
             }
             break;
-        case 'o':
-            outfile = fopen(optarg, "w");
-            //if file can't be opened, print to standard error
-            if (outfile == NULL) {
-                fprintf(stderr, "%s: No such file or directory\n", optarg);
-                return EXIT_FAILURE;
-            }
+        case 'o': outname = optarg; break;
+        case OPT_CHECKPOINT: checkpoint = true; break;
+        case OPT_RESUME:
+            checkpoint = true;
+            resume = true;
             break;
+        case OPT_LEGACY: legacy = true; break;
         case 'n':
             pvfile = fopen(optarg, "r");
             //if file can't be opened, print to standard error
@@ -79,6 +175,22 @@ int main(int argc, char **argv) {
                 return EXIT_FAILURE;
             }
             break;
+        case 'l':
+            batch = true;
+            if (!filelist_read(&list, optarg)) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'd':
+            batch = true;
+            dirname = optarg;
+            break;
+        case 'x': suffix = optarg; break;
+        case 't':
+            threads = (uint32_t) strtoul(optarg, NULL, 10);
+            threads_set = true;
+            break;
+        case 'r': records = true; break;
         case 'v': verbose = true; break;
         case 'h':
             usage(argv[0]);
@@ -87,6 +199,60 @@ int main(int argc, char **argv) {
         default: usage(argv[0]); return EXIT_FAILURE;
         }
     }
+    //operands are batch files
+    for (int i = optind; i < argc; i += 1) {
+        batch = true;
+        if (!filelist_add(&list, argv[i])) {
+            fprintf(stderr, "Error: out of memory.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    //the walk is done once the suffix is known
+    if (dirname != NULL) {
+        size_t first = list.count;
+        if (!filelist_walk(&list, dirname)) {
+            return EXIT_FAILURE;
+        }
+        filelist_filter_suffix(&list, first, suffix, true);
+    }
+
+    //every batch file has its own output next to it
+    if (batch && (infile != stdin || outname != NULL)) {
+        fprintf(stderr, "Error: -i and -o cannot be used with batch files.\n");
+        return EXIT_FAILURE;
+    }
+
+    //batch files are decrypted whole, so records are not written one at a time
+    if (batch && records) {
+        fprintf(stderr, "Error: -r cannot be used with batch files.\n");
+        return EXIT_FAILURE;
+    }
+
+    //old ciphertext has neither records nor an end-of-stream line to check progress against
+    if (legacy && (records || checkpoint)) {
+        fprintf(stderr, "Error: --legacy cannot be used with -r, --checkpoint or --resume.\n");
+        return EXIT_FAILURE;
+    }
+
+    //checkpoints follow a single stream of plain blocks into a named output file
+    if (checkpoint && (outname == NULL || batch || records)) {
+        fprintf(stderr, "Error: --checkpoint and --resume need -o, and no -r or batch files.\n");
+        return EXIT_FAILURE;
+    }
+
+    //a resumed output is kept up to its checkpoint, so it is opened without truncating it
+    if (outname != NULL) {
+        outfile = fopen(outname, resume ? "r+" : "w");
+        if (outfile == NULL && resume) {
+            outfile = fopen(outname, "w+");
+        }
+        //if file can't be opened, print to standard error
+        if (outfile == NULL) {
+            fprintf(stderr, "%s: No such file or directory\n", outname);
+            return EXIT_FAILURE;
+        }
+    }
+
     //read the private key file
     rsa_read_priv(n, d, pvfile);
 
@@ -95,12 +261,82 @@ int main(int argc, char **argv) {
         gmp_printf("n (%zu bits) = %Zd\n", mpz_sizeinbase(n, 2), n);
         gmp_printf("d (%zu bits) = %Zd\n", mpz_sizeinbase(d, 2), d);
     }
-    //decrypt the file
-    rsa_decrypt_file(infile, outfile, n, d);
+    //loading the settings tuned for this key size
+    profile_t profile;
+    if (profile_load(&profile, profile_path(), mpz_sizeinbase(n, 2))) {
+        profile_apply(&profile);
+        if (!threads_set) {
+            threads = profile.threads;
+        }
+        if (verbose) {
+            printf("profile = %s, window %" PRIu32 ", %" PRIu32 " threads\n",
+                profile_method_name(profile.method), profile.window, profile.threads);
+        }
+    }
+
+    int status = EXIT_SUCCESS;
+    if (batch) {
+        //the key is loaded once for the whole batch
+        batch_t settings = { n, d, verbose, legacy, suffix };
+        uint64_t failed = batch_run(&list, threads, decrypt_one, &settings);
+        if (failed > 0) {
+            fprintf(stderr, "Error: %" PRIu64 " of %zu files failed.\n", failed, list.count);
+            status = EXIT_FAILURE;
+        }
+    } else if (records) {
+        //each record is written and flushed before the next one is read
+        rsa_record_reader_t reader;
+        uint8_t *record;
+        size_t len;
+        int got = 0;
+        if (rsa_record_reader_init(&reader, infile, n, d)) {
+            while ((got = rsa_read_record(&reader, &record, &len)) > 0) {
+                if (fwrite(record, sizeof(uint8_t), len, outfile) != len || fflush(outfile) != 0) {
+                    fprintf(stderr, "Error: the output cannot be written.\n");
+                    got = -1;
+                    break;
+                }
+            }
+        } else {
+            fprintf(stderr, "Error: out of memory.\n");
+            got = -1;
+        }
+        rsa_record_reader_clear(&reader);
+        if (got < 0) {
+            status = EXIT_FAILURE;
+        }
+    } else if (checkpoint) {
+        char ckptname[4096];
+        snprintf(ckptname, sizeof(ckptname), "%s.ckpt", outname);
+        if (!rsa_decrypt_file_checkpoint(infile, outfile, n, d, ckptname, resume)) {
+            status = EXIT_FAILURE;
+        }
+    } else {
+        //decrypt the file
+        if (!rsa_decrypt_file(infile, outfile, n, d, legacy)) {
+            status = EXIT_FAILURE;
+        }
+    }
+
+    //allocation counts go to standard error, away from any output on standard output
+    if (verbose) {
+        arena_print_stats(stderr);
+    }
 
     //clear mz_t variables, and close files
+    filelist_clear(&list);
     mpz_clears(d, e, n, s, NULL);
     fclose(pvfile);
     fclose(infile);
-    fclose(outfile);
+    //the output of a single stream is only complete once it is flushed and closed, and
+    //write errors found while decrypting have already been reported
+    bool written = !ferror(outfile);
+    written = (fclose(outfile) == 0) && written;
+    if (!written) {
+        if (status == EXIT_SUCCESS) {
+            fprintf(stderr, "Error: the output cannot be written.\n");
+        }
+        status = EXIT_FAILURE;
+    }
+    return status;
 }
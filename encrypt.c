@@ -7,9 +7,13 @@
 #include "numtheory.h"
 #include <inttypes.h>
 #include "rsa.h"
+#include "arena.h"
+#include "batch.h"
+#include "profile.h"
 #include <time.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <getopt.h>
 
 //Pseudocode for this file is given in the Assignment 5 doc.
 
@@ -22,15 +26,93 @@ void usage(char *val) {
     fprintf(stderr, "   Encrypts data using RSA encryption.\n");
     fprintf(stderr, "   Encrypted data is decrypted by the decrypt program.\n\n");
     fprintf(stderr, "USAGE\n");
-    fprintf(stderr, "   %s [OPTIONS]\n\n", val);
+    fprintf(stderr, "   %s [OPTIONS] [files...]\n\n", val);
     fprintf(stderr, "OPTIONS\n"
                     "   -h              Display program help and usage.\n"
                     "   -v              Display verbose program output.\n"
+                    "   -c              Compress data before encrypting it.\n"
+                    "   -r              Encrypt each line as a separate record, on -t threads.\n"
                     "   -i infile       Input file of data to encrypt (default: stdin).\n"
                     "   -o outfile      Output file for decrypted data (default: stdout).\n"
-                    "   -n pvfile       Public key file (default: rsa.pub).\n");
+                    "   -n pbfile       Public key file (default: rsa.pub). Repeat for several\n"
+                    "                   recipients: the data is encrypted once, and each\n"
+                    "                   recipient decrypts it with their own private key.\n"
+                    "   -l listfile     Encrypt every file listed in listfile, one per line.\n"
+                    "   -d dir          Encrypt every file below dir not ending in the suffix.\n"
+                    "   -x suffix       Suffix added to batch output names (default: .rsa).\n"
+                    "   -t threads      Files encrypted at once in batch mode (default: the tuning\n"
+                    "                   profile, or online CPUs).\n"
+                    "   --checkpoint    Save progress to outfile.ckpt every 10 seconds, so an\n"
+                    "                   interrupted run can be resumed. Needs -o.\n"
+                    "   --resume        Check the output against outfile.ckpt and continue from it.\n"
+                    "\n"
+                    "   Files given as operands, with -l or with -d are encrypted in batch:\n"
+                    "   file is encrypted to file.rsa with the key read only once.\n");
 }
 
+//Settings shared by every file of a batch.
+typedef struct {
+    mpz_t *n;
+    mpz_t *e;
+    size_t keys;
+    bool records;
+    bool compress;
+    bool verbose;
+    char *suffix;
+} batch_t;
+
+//Encrypts one file of a batch to the file with the batch suffix added.
+//Returns true if the file was encrypted.
+//
+//path: file to encrypt.
+//arg: pointer to the batch_t settings.
+bool encrypt_one(const char *path, void *arg) {
+    batch_t *batch = (batch_t *) arg;
+    char outname[4096];
+
+    snprintf(outname, sizeof(outname), "%s%s", path, batch->suffix);
+    FILE *infile = fopen(path, "rb");
+    if (infile == NULL) {
+        fprintf(stderr, "%s: No such file or directory\n", path);
+        return false;
+    }
+    FILE *outfile = fopen(outname, "w");
+    if (outfile == NULL) {
+        fprintf(stderr, "%s: No such file or directory\n", outname);
+        fclose(infile);
+        return false;
+    }
+
+    bool ok = true;
+    if (batch->records) {
+        ok = rsa_encrypt_file_records(infile, outfile, batch->n[0], batch->e[0], 1);
+    } else if (batch->keys > 1) {
+        ok = rsa_encrypt_file_multi(infile, outfile, batch->n, batch->e, batch->keys, batch->compress);
+    } else if (batch->compress) {
+        ok = rsa_encrypt_file_compressed(infile, outfile, batch->n[0], batch->e[0]);
+    } else {
+        ok = rsa_encrypt_file(infile, outfile, batch->n[0], batch->e[0]);
+    }
+    ok = !ferror(infile) && !ferror(outfile) && ok;
+    fclose(infile);
+    ok = (fclose(outfile) == 0) && ok;
+
+    if (batch->verbose) {
+        printf("%s -> %s\n", path, outname);
+    }
+    return ok;
+}
+
+//Options with only a long form.
+#define OPT_CHECKPOINT 256
+#define OPT_RESUME     257
+
+static struct option long_options[] = {
+    { "checkpoint", no_argument, NULL, OPT_CHECKPOINT },
+    { "resume", no_argument, NULL, OPT_RESUME },
+    { NULL, 0, NULL, 0 },
+};
+
 //Parses command-line options, and encrypts text from a given input file using a pbfile.
 //Returns a 0 or 1 depending on succesful exit of program.
 //
@@ -39,24 +121,41 @@ void usage(char *val) {
 int main(int argc, char **argv) {
     int64_t opt;
 
-    //initializes verbose to false
+    //initializes verbose, compress and record mode to false
     bool verbose = false;
+    bool compress = false;
+    bool records = false;
+
+    //batch mode settings
+    filelist_t list;
+    filelist_init(&list);
+    bool batch = false;
+    char *suffix = ".rsa";
+    char *dirname = NULL;
+    uint32_t threads = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+    bool threads_set = false;
 
     //opening files
     FILE *infile = stdin;
     FILE *outfile = stdout;
-    FILE *pbfile = fopen("rsa.pub", "r");
+    char *outname = NULL;
+    bool checkpoint = false;
+    bool resume = false;
+    FILE **pbfiles = NULL;
+    size_t keys = 0;
 
-    mpz_t p, q, d, e, n, user, s;
+    //GMP allocates through the arenas from here on
+    arena_install();
+    mpz_t user, s;
 
     //creating a character array to hold user's name:
     //I was notified that this notation works to initialize the array from Awano on the cse13s discord.
     char username[256] = { 0 };
 
-    mpz_inits(p, q, d, e, n, user, s, NULL);
+    mpz_inits(user, s, NULL);
 
     //Parsing command line options
-    while ((opt = getopt(argc, argv, "i:o:n:vh")) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:o:n:l:d:x:t:rcvh", long_options, NULL)) != -1) {
         switch (opt) {
         case 'i':
             infile = fopen(optarg, "r");
@@ -66,22 +165,45 @@ int main(int argc, char **argv) {
                 return EXIT_FAILURE;
             }
             break;
-        case 'o':
-            outfile = fopen(optarg, "w");
+        case 'o': outname = optarg; break;
+        case OPT_CHECKPOINT: checkpoint = true; break;
+        case OPT_RESUME:
+            checkpoint = true;
+            resume = true;
+            break;
+        case 'n': {
+            FILE **grown = (FILE **) realloc(pbfiles, (keys + 1) * sizeof(FILE *));
+            if (grown == NULL) {
+                fprintf(stderr, "Error: out of memory.\n");
+                return EXIT_FAILURE;
+            }
+            pbfiles = grown;
+            pbfiles[keys] = fopen(optarg, "r");
             //if file can't be opened, print to standard error
-            if (outfile == NULL) {
+            if (pbfiles[keys] == NULL) {
                 fprintf(stderr, "%s: No such file or directory\n", optarg);
                 return EXIT_FAILURE;
             }
+            keys += 1;
             break;
-        case 'n':
-            pbfile = fopen(optarg, "r");
-            //if file can't be opened, print to standard error
-            if (pbfile == NULL) {
-                fprintf(stderr, "%s: No such file or directory\n", optarg);
+        }
+        case 'l':
+            batch = true;
+            if (!filelist_read(&list, optarg)) {
                 return EXIT_FAILURE;
             }
             break;
+        case 'd':
+            batch = true;
+            dirname = optarg;
+            break;
+        case 'x': suffix = optarg; break;
+        case 't':
+            threads = (uint32_t) strtoul(optarg, NULL, 10);
+            threads_set = true;
+            break;
+        case 'r': records = true; break;
+        case 'c': compress = true; break;
         case 'v': verbose = true; break;
         case 'h':
             usage(argv[0]);
@@ -91,26 +213,155 @@ int main(int argc, char **argv) {
         }
     }
 
-    //read n, e, s, username values from pbfile.
-    rsa_read_pub(n, e, s, username, pbfile);
+    //operands are batch files
+    for (int i = optind; i < argc; i += 1) {
+        batch = true;
+        if (!filelist_add(&list, argv[i])) {
+            fprintf(stderr, "Error: out of memory.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    //the walk is done once the suffix is known, and leaves out the outputs of earlier runs
+    if (dirname != NULL) {
+        size_t first = list.count;
+        if (!filelist_walk(&list, dirname)) {
+            return EXIT_FAILURE;
+        }
+        filelist_filter_suffix(&list, first, suffix, false);
+    }
+
+    //every batch file has its own output next to it
+    if (batch && (infile != stdin || outname != NULL)) {
+        fprintf(stderr, "Error: -i and -o cannot be used with batch files.\n");
+        return EXIT_FAILURE;
+    }
 
-    if (verbose) {
-        printf("user = %s\n", username);
-        gmp_printf("s (%zu bits) = %Zd\n", mpz_sizeinbase(s, 2), s);
-        gmp_printf("n (%zu bits) = %Zd\n", mpz_sizeinbase(n, 2), n);
-        gmp_printf("e (%zu bits) = %Zd\n", mpz_sizeinbase(e, 2), e);
+    //records are encrypted on their own, so they cannot share compression or a session key
+    if (records && (compress || keys > 1)) {
+        fprintf(stderr, "Error: -r cannot be used with -c or several -n keys.\n");
+        return EXIT_FAILURE;
     }
 
-    mpz_set_str(user, username, 62);
+    //checkpoints follow a single stream of plain blocks into a named output file
+    if (checkpoint && (outname == NULL || batch || records || compress || keys > 1)) {
+        fprintf(stderr, "Error: --checkpoint and --resume need -o, one -n key and no -c, -r or batch files.\n");
+        return EXIT_FAILURE;
+    }
+
+    //a resumed output is kept up to its checkpoint, so it is opened without truncating it
+    if (outname != NULL) {
+        outfile = fopen(outname, resume ? "r+" : "w");
+        if (outfile == NULL && resume) {
+            outfile = fopen(outname, "w+");
+        }
+        //if file can't be opened, print to standard error
+        if (outfile == NULL) {
+            fprintf(stderr, "%s: No such file or directory\n", outname);
+            return EXIT_FAILURE;
+        }
+    }
+
+    //the default key file, if no -n was given
+    if (keys == 0) {
+        pbfiles = (FILE **) malloc(sizeof(FILE *));
+        pbfiles[0] = fopen("rsa.pub", "r");
+        if (pbfiles[0] == NULL) {
+            fprintf(stderr, "rsa.pub: No such file or directory\n");
+            return EXIT_FAILURE;
+        }
+        keys = 1;
+    }
+
+    //read n, e, s, username values from each pbfile.
+    mpz_t *n = (mpz_t *) calloc(keys, sizeof(mpz_t));
+    mpz_t *e = (mpz_t *) calloc(keys, sizeof(mpz_t));
+    for (size_t i = 0; i < keys; i += 1) {
+        mpz_inits(n[i], e[i], NULL);
+        rsa_read_pub(n[i], e[i], s, username, pbfiles[i]);
+        fclose(pbfiles[i]);
+
+        if (verbose) {
+            printf("user = %s\n", username);
+            gmp_printf("s (%zu bits) = %Zd\n", mpz_sizeinbase(s, 2), s);
+            gmp_printf("n (%zu bits) = %Zd\n", mpz_sizeinbase(n[i], 2), n[i]);
+            gmp_printf("e (%zu bits) = %Zd\n", mpz_sizeinbase(e[i], 2), e[i]);
+        }
+
+        mpz_set_str(user, username, 62);
+
+        if (!rsa_verify(user, s, e[i], n[i])) {
+            fprintf(stderr, "Error: invalid key.\n");
+        }
+    }
+    free(pbfiles);
+
+    //loading the settings tuned for this key size
+    profile_t profile;
+    if (profile_load(&profile, profile_path(), mpz_sizeinbase(n[0], 2))) {
+        profile_apply(&profile);
+        if (!threads_set) {
+            threads = profile.threads;
+        }
+        if (verbose) {
+            printf("profile = %s, window %" PRIu32 ", %" PRIu32 " threads\n",
+                profile_method_name(profile.method), profile.window, profile.threads);
+        }
+    }
+
+    int status = EXIT_SUCCESS;
+    if (batch) {
+        //the keys are loaded and verified once for the whole batch
+        batch_t settings = { n, e, keys, records, compress, verbose, suffix };
+        uint64_t failed = batch_run(&list, threads, encrypt_one, &settings);
+        if (failed > 0) {
+            fprintf(stderr, "Error: %" PRIu64 " of %zu files failed.\n", failed, list.count);
+            status = EXIT_FAILURE;
+        }
+    } else if (records) {
+        if (!rsa_encrypt_file_records(infile, outfile, n[0], e[0], threads)) {
+            status = EXIT_FAILURE;
+        }
+    } else if (keys > 1) {
+        //one pass over the data for every recipient
+        if (!rsa_encrypt_file_multi(infile, outfile, n, e, keys, compress)) {
+            status = EXIT_FAILURE;
+        }
+    } else if (checkpoint) {
+        char ckptname[4096];
+        snprintf(ckptname, sizeof(ckptname), "%s.ckpt", outname);
+        if (!rsa_encrypt_file_checkpoint(infile, outfile, n[0], e[0], ckptname, resume)) {
+            status = EXIT_FAILURE;
+        }
+    } else if (compress) {
+        if (!rsa_encrypt_file_compressed(infile, outfile, n[0], e[0])) {
+            status = EXIT_FAILURE;
+        }
+    } else {
+        if (!rsa_encrypt_file(infile, outfile, n[0], e[0])) {
+            status = EXIT_FAILURE;
+        }
+    }
 
-    if (!rsa_verify(user, s, e, n)) {
-        fprintf(stderr, "Error: invalid key.\n");
+    //allocation counts go to standard error, away from any output on standard output
+    if (verbose) {
+        arena_print_stats(stderr);
     }
 
     //close all files, clear mpz_t variables, and clear randstate
-    rsa_encrypt_file(infile, outfile, n, e);
-    mpz_clears(p, q, d, e, n, user, s, NULL);
-    fclose(pbfile);
+    filelist_clear(&list);
+    for (size_t i = 0; i < keys; i += 1) {
+        mpz_clears(n[i], e[i], NULL);
+    }
+    free(n);
+    free(e);
+    mpz_clears(user, s, NULL);
     fclose(infile);
-    fclose(outfile);
+    //the output of a single stream is only complete once it is flushed and closed
+    bool written = !ferror(outfile);
+    written = (fclose(outfile) == 0) && written;
+    if (!written) {
+        fprintf(stderr, "Error: the output cannot be written.\n");
+        status = EXIT_FAILURE;
+    }
+    return status;
 }
@@ -0,0 +1,461 @@
+#include "hex.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include <errno.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//Hex codec for the ciphertext format. The line format is the one gmp_fprintf
+//writes for "%Zx\n", but numbers are converted through byte buffers a whole
+//buffer at a time instead of through stdio format strings.
+
+static const char digits[] = "0123456789abcdef";
+
+//Converts len bytes to 2 * len lowercase hex characters.
+//Returns nothing (void).
+//
+//out: buffer with room for 2 * len characters. No terminator is written.
+//in: bytes to convert.
+//len: number of bytes.
+void hex_encode(char *out, const uint8_t *in, size_t len) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    //16 bytes at a time: split the nibbles, map 0-9 to '0'-'9' and 10-15 to 'a'-'f',
+    //then interleave the high and low nibble characters
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i gap = _mm_set1_epi8('a' - '0' - 10);
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+        __m128i lo = _mm_and_si128(v, mask);
+
+        hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), gap));
+        lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), gap));
+
+        _mm_storeu_si128((__m128i *) (out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *) (out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#endif
+
+    for (; i < len; i += 1) {
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 0x0F];
+    }
+}
+
+//Converts one hex character to its value.
+//Returns the value, or -1 if c is not a hex digit.
+//
+//c: the character.
+static int nibble(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+//Converts 2 * len hex characters (either case) to len bytes.
+//Returns false if a character is not a hex digit.
+//
+//out: buffer with room for len bytes.
+//in: 2 * len hex characters.
+//len: number of bytes to produce.
+bool hex_decode(uint8_t *out, const char *in, size_t len) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    //32 characters at a time: classify and convert every character, check that all
+    //of them were digits, then combine pairs of nibbles in 16 bit lanes
+    const __m128i below0 = _mm_set1_epi8('0' - 1);
+    const __m128i above9 = _mm_set1_epi8('9' + 1);
+    const __m128i belowa = _mm_set1_epi8('a' - 1);
+    const __m128i abovef = _mm_set1_epi8('f' + 1);
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i alpha = _mm_set1_epi8('a' - 10);
+    const __m128i high = _mm_set1_epi16(0x00F0);
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i pairs[2];
+        bool valid = true;
+
+        for (uint32_t h = 0; h < 2; h += 1) {
+            __m128i c = _mm_loadu_si128((const __m128i *) (in + 2 * i + 16 * h));
+            __m128i l = _mm_or_si128(c, lower);
+            __m128i isdig = _mm_and_si128(_mm_cmpgt_epi8(c, below0), _mm_cmplt_epi8(c, above9));
+            __m128i isalp = _mm_and_si128(_mm_cmpgt_epi8(l, belowa), _mm_cmplt_epi8(l, abovef));
+
+            valid = valid && (_mm_movemask_epi8(_mm_or_si128(isdig, isalp)) == 0xFFFF);
+
+            __m128i v = _mm_or_si128(_mm_and_si128(isdig, _mm_sub_epi8(c, zero)),
+                _mm_and_si128(isalp, _mm_sub_epi8(l, alpha)));
+            //lane = first nibble | second nibble << 8, byte = first << 4 | second
+            pairs[h] = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(v, 4), high), _mm_srli_epi16(v, 8));
+        }
+        if (!valid) {
+            return false;
+        }
+        _mm_storeu_si128((__m128i *) (out + i), _mm_packus_epi16(pairs[0], pairs[1]));
+    }
+#endif
+
+    for (; i < len; i += 1) {
+        int hi = nibble(in[2 * i]);
+        int lo = nibble(in[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = (uint8_t) ((hi << 4) | lo);
+    }
+    return true;
+}
+
+//Makes sure a byte buffer holds at least need bytes.
+//Returns false if memory ran out.
+//
+//bytes: the buffer, reallocated if it is too small.
+//cap: capacity of the buffer.
+//need: bytes needed.
+static bool reserve(uint8_t **bytes, size_t *cap, size_t need) {
+    if (need <= *cap) {
+        return true;
+    }
+    uint8_t *grown = (uint8_t *) realloc(*bytes, need);
+    if (grown == NULL) {
+        return false;
+    }
+    *bytes = grown;
+    *cap = need;
+    return true;
+}
+
+//Initializes a writer that buffers hex lines for file.
+//Returns false if memory could not be allocated.
+//
+//w: the writer to initialize.
+//file: file to write to.
+bool hex_writer_init(hex_writer_t *w, FILE *file) {
+    w->file = file;
+    w->buf = (char *) malloc(HEX_BUFFER_BYTES);
+    w->len = 0;
+    w->bytes = NULL;
+    w->bytes_cap = 0;
+    return w->buf != NULL;
+}
+
+//Writes the buffered lines to the file.
+//Returns false if the write failed.
+//
+//w: an initialized writer.
+bool hex_writer_flush(hex_writer_t *w) {
+    bool ok = fwrite(w->buf, sizeof(char), w->len, w->file) == w->len;
+    w->len = 0;
+    return ok;
+}
+
+//Formats x as a line of lowercase hex with no leading zeros, as "%Zx\n" does.
+//Returns the length of the line, or 0 if memory ran out.
+//
+//out: room for hex_line_bytes(x) characters. No terminator is written.
+//x: the number to format.
+//bytes, cap: scratch buffer for the bytes of x, grown as needed.
+size_t hex_format_mpz(char *out, mpz_t x, uint8_t **bytes, size_t *cap) {
+    size_t count = (mpz_sizeinbase(x, 2) + 7) / 8;
+    if (!reserve(bytes, cap, count)) {
+        return 0;
+    }
+    mpz_export(*bytes, &count, 1, sizeof(uint8_t), 1, 0, x);
+
+    size_t len = 0;
+    if (mpz_sgn(x) < 0) {
+        out[len++] = '-';
+    }
+    if (count == 0) {
+        out[len++] = '0';
+    } else if ((*bytes)[0] < 0x10) {
+        //a leading zero nibble is not printed
+        out[len++] = digits[(*bytes)[0]];
+        hex_encode(out + len, *bytes + 1, count - 1);
+        len += 2 * (count - 1);
+    } else {
+        hex_encode(out + len, *bytes, count);
+        len += 2 * count;
+    }
+    out[len++] = '\n';
+    return len;
+}
+
+//Calculates the longest line hex_format_mpz() may write for x.
+//Returns the number of characters: sign, digits and newline.
+//
+//x: the number to format.
+size_t hex_line_bytes(mpz_t x) {
+    return 2 * ((mpz_sizeinbase(x, 2) + 7) / 8) + 2;
+}
+
+//Writes x as a line of lowercase hex with no leading zeros, as "%Zx\n" does.
+//Returns false if a write failed or memory ran out.
+//
+//w: an initialized writer.
+//x: the number to write.
+bool hex_write_mpz(hex_writer_t *w, mpz_t x) {
+    size_t need = hex_line_bytes(x);
+    if (w->len + need > HEX_BUFFER_BYTES && !hex_writer_flush(w)) {
+        return false;
+    }
+
+    char *out = w->buf + w->len;
+    char *big = NULL;
+    if (need > HEX_BUFFER_BYTES) {
+        big = (char *) malloc(need);
+        if (big == NULL) {
+            return false;
+        }
+        out = big;
+    }
+
+    size_t len = hex_format_mpz(out, x, &w->bytes, &w->bytes_cap);
+    if (len == 0) {
+        free(big);
+        return false;
+    }
+
+    if (big != NULL) {
+        bool ok = fwrite(big, sizeof(char), len, w->file) == len;
+        free(big);
+        return ok;
+    }
+    w->len += len;
+    return true;
+}
+
+//Writes a line of text as is.
+//Returns false if a write failed.
+//
+//w: an initialized writer.
+//text: the line, including its newline.
+bool hex_write_text(hex_writer_t *w, const char *text) {
+    size_t len = strlen(text);
+    if (w->len + len > HEX_BUFFER_BYTES && !hex_writer_flush(w)) {
+        return false;
+    }
+    if (len > HEX_BUFFER_BYTES) {
+        return fwrite(text, sizeof(char), len, w->file) == len;
+    }
+    memcpy(w->buf + w->len, text, len);
+    w->len += len;
+    return true;
+}
+
+//Flushes the writer and frees its memory. The file is not closed.
+//Returns false if the final write failed.
+//
+//w: an initialized writer.
+bool hex_writer_clear(hex_writer_t *w) {
+    bool ok = hex_writer_flush(w);
+    free(w->buf);
+    free(w->bytes);
+    w->buf = NULL;
+    w->bytes = NULL;
+    return ok;
+}
+
+//Initializes a reader that takes hex lines from file, reading a buffer at a time.
+//The reader reads the file descriptor directly, so it works on pipes, FIFOs and sockets
+//in a single pass. Nothing may have been read from file through stdio before.
+//Returns false if memory could not be allocated.
+//
+//r: the reader to initialize.
+//file: file to read from its current position, or NULL for input given with hex_reader_push().
+bool hex_reader_init(hex_reader_t *r, FILE *file) {
+    r->file = file;
+    r->cap = HEX_BUFFER_BYTES;
+    r->buf = (char *) malloc(r->cap);
+    r->pos = 0;
+    r->len = 0;
+    r->eof = false;
+    r->total = 0;
+    r->bytes = NULL;
+    r->bytes_cap = 0;
+    return r->buf != NULL;
+}
+
+//Finds the next non-empty line, with surrounding blanks and carriage returns removed.
+//The line stays valid until the next read.
+//Returns 1 if a line was found, 0 at the end of the input, -1 if a line is too long.
+//A reader with no file also returns 0 when the rest of the line has not been pushed yet,
+//which is the end of the input only once eof is set.
+//
+//r: an initialized reader.
+//line: set to the first character of the line (not terminated).
+//len: set to the length of the line.
+int hex_read_line(hex_reader_t *r, char **line, size_t *len) {
+    while (true) {
+        char *start = r->buf + r->pos;
+        char *end = (char *) memchr(start, '\n', r->len - r->pos);
+
+        //the last line may have no newline
+        if (end == NULL && r->eof) {
+            if (r->pos == r->len) {
+                return 0;
+            }
+            end = r->buf + r->len;
+        }
+
+        if (end != NULL) {
+            r->pos = (size_t) (end - r->buf) + ((end < r->buf + r->len) ? 1 : 0);
+            while (start < end && (*start == ' ' || *start == '\t' || *start == '\r')) {
+                start += 1;
+            }
+            while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+                end -= 1;
+            }
+            if (end == start) {
+                continue;
+            }
+            *line = start;
+            *len = (size_t) (end - start);
+            return 1;
+        }
+
+        //pushed input has no file to read the rest of the line from
+        if (r->file == NULL) {
+            return (r->len - r->pos >= HEX_LINE_MAX) ? -1 : 0;
+        }
+
+        //moving the partial line to the front and reading more
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+        if (r->len == r->cap) {
+            if (r->cap >= HEX_LINE_MAX) {
+                return -1;
+            }
+            char *grown = (char *) realloc(r->buf, 2 * r->cap);
+            if (grown == NULL) {
+                return -1;
+            }
+            r->buf = grown;
+            r->cap *= 2;
+        }
+        //read() returns whatever a pipe or socket has ready instead of waiting to fill the buffer
+        ssize_t got;
+        do {
+            got = read(fileno(r->file), r->buf + r->len, r->cap - r->len);
+        } while (got < 0 && errno == EINTR);
+        if (got <= 0) {
+            r->eof = true;
+        } else {
+            r->len += (size_t) got;
+            r->total += (uint64_t) got;
+        }
+    }
+}
+
+//Converts a line of hex digits to a number.
+//Returns false if the line is not a hex number.
+//
+//r: an initialized reader, whose byte buffer is used.
+//x: initialized mpz_t to store the number in.
+//line: the hex digits.
+//len: number of digits.
+bool hex_parse_mpz(hex_reader_t *r, mpz_t x, const char *line, size_t len) {
+    size_t count = (len + 1) / 2;
+    if (len == 0 || !reserve(&r->bytes, &r->bytes_cap, count)) {
+        return false;
+    }
+
+    //an odd number of digits starts with a single nibble
+    size_t first = len % 2;
+    if (first == 1) {
+        int v = nibble(line[0]);
+        if (v < 0) {
+            return false;
+        }
+        r->bytes[0] = (uint8_t) v;
+    }
+    if (!hex_decode(r->bytes + first, line + first, len / 2)) {
+        return false;
+    }
+    mpz_import(x, count, 1, sizeof(uint8_t), 1, 0, r->bytes);
+    return true;
+}
+
+//Reads the next number.
+//Returns 1 if a number was read, 0 at the end of the input, -1 if a line is not a hex number.
+//
+//r: an initialized reader.
+//x: initialized mpz_t to store the number in.
+int hex_read_mpz(hex_reader_t *r, mpz_t x) {
+    char *line;
+    size_t len;
+
+    int got = hex_read_line(r, &line, &len);
+    if (got <= 0) {
+        return got;
+    }
+    return hex_parse_mpz(r, x, line, len) ? 1 : -1;
+}
+
+//Adds bytes to a reader initialized with no file, for input that arrives in pieces.
+//Lines already returned by hex_read_line() become invalid.
+//Returns false if memory ran out.
+//
+//r: a reader initialized with a NULL file.
+//data: the next bytes of the input.
+//len: number of bytes in data.
+bool hex_reader_push(hex_reader_t *r, const char *data, size_t len) {
+    memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+    r->len -= r->pos;
+    r->pos = 0;
+    if (r->len + len > r->cap) {
+        size_t cap = r->cap;
+        while (cap < r->len + len) {
+            cap *= 2;
+        }
+        char *grown = (char *) realloc(r->buf, cap);
+        if (grown == NULL) {
+            return false;
+        }
+        r->buf = grown;
+        r->cap = cap;
+    }
+    memcpy(r->buf + r->len, data, len);
+    r->len += len;
+    r->total += len;
+    return true;
+}
+
+//Counts the input bytes taken by the lines read so far, blank lines included.
+//Returns the number of bytes since the reader was initialized.
+//
+//r: an initialized reader.
+uint64_t hex_reader_offset(hex_reader_t *r) {
+    return r->total - (r->len - r->pos);
+}
+
+//Frees the memory of a reader. The file is not closed.
+//Returns nothing (void).
+//
+//r: an initialized reader.
+void hex_reader_clear(hex_reader_t *r) {
+    free(r->buf);
+    free(r->bytes);
+    r->buf = NULL;
+    r->bytes = NULL;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <gmp.h>
+
+//Size of the buffers hex readers and writers move data through (64 KiB).
+#define HEX_BUFFER_BYTES (1 << 16)
+
+//Longest line a hex reader accepts (1 MiB).
+#define HEX_LINE_MAX (1 << 20)
+
+//Writes numbers as lowercase hex lines, identical to gmp_fprintf(file, "%Zx\n", x).
+typedef struct {
+    FILE *file;
+    char *buf;
+    size_t len;
+    uint8_t *bytes;
+    size_t bytes_cap;
+} hex_writer_t;
+
+//Reads numbers written one per line in hex.
+typedef struct {
+    FILE *file;
+    char *buf;
+    size_t pos;
+    size_t len;
+    size_t cap;
+    bool eof;
+    uint64_t total;
+    uint8_t *bytes;
+    size_t bytes_cap;
+} hex_reader_t;
+
+void hex_encode(char *out, const uint8_t *in, size_t len);
+
+bool hex_decode(uint8_t *out, const char *in, size_t len);
+
+size_t hex_format_mpz(char *out, mpz_t x, uint8_t **bytes, size_t *cap);
+
+size_t hex_line_bytes(mpz_t x);
+
+bool hex_writer_init(hex_writer_t *w, FILE *file);
+
+bool hex_write_mpz(hex_writer_t *w, mpz_t x);
+
+bool hex_write_text(hex_writer_t *w, const char *text);
+
+bool hex_writer_flush(hex_writer_t *w);
+
+bool hex_writer_clear(hex_writer_t *w);
+
+bool hex_reader_init(hex_reader_t *r, FILE *file);
+
+int hex_read_line(hex_reader_t *r, char **line, size_t *len);
+
+bool hex_parse_mpz(hex_reader_t *r, mpz_t x, const char *line, size_t len);
+
+int hex_read_mpz(hex_reader_t *r, mpz_t x);
+
+bool hex_reader_push(hex_reader_t *r, const char *data, size_t len);
+
+uint64_t hex_reader_offset(hex_reader_t *r);
+
+void hex_reader_clear(hex_reader_t *r);
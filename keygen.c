@@ -4,9 +4,12 @@
 #include <gmp.h>
 #include "randstate.h"
 #include <stdlib.h>
+#include <string.h>
 #include "numtheory.h"
 #include <inttypes.h>
 #include "rsa.h"
+#include "arena.h"
+#include "profile.h"
 #include <time.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -26,10 +29,14 @@ void usage(char *val) {
                     "   -h              Display program help and usage.\n"
                     "   -v              Display verbose program output.\n"
                     "   -b bits         Minimum bits needed for public key n (default: 256).\n"
-                    "   -i iterations   Miller-Rabin iterations for testing primes (default: 50).\n"
+                    "   -i iterations   Miller-Rabin iterations for testing primes\n"
+                    "                   (default: 50 with -m mr, 0 extra rounds with -m bpsw).\n"
+                    "   -m test         Primality test, bpsw or mr (default: bpsw).\n"
                     "   -n pbfile       Public key file (default: rsa.pub).\n"
                     "   -d pvfile       Private key file (default: rsa.priv).\n"
-                    "   -s seed         Random seed for testing.\n");
+                    "   -s seed         Random seed for testing.\n"
+                    "   -t threads      Threads used to search for primes\n"
+                    "                   (default: the tuning profile, or 1).\n");
 }
 
 //Parses command-line options, and writes public and private keys to their respective file.
@@ -39,6 +46,11 @@ void usage(char *val) {
 //argv stores command-line options passed
 int main(int argc, char **argv) {
     uint64_t bits = 256, iters = 50, seed, pb_fd, pv_fd;
+    uint32_t threads = 1;
+    bool threads_set = false;
+    prime_test_t test = PRIME_BPSW;
+    bool iters_set = false;
+    randstate_t rs;
     int64_t opt;
 
     //setting default verbose value
@@ -49,6 +61,8 @@ int main(int argc, char **argv) {
     FILE *pvfile = fopen("rsa.priv", "w");
 
     //Declaring and initializing mpz_t variables
+    //GMP allocates through the arenas from here on
+    arena_install();
     mpz_t p, q, d, e, n, username, s;
     mpz_inits(p, q, d, e, n, username, s, NULL);
 
@@ -57,10 +71,23 @@ int main(int argc, char **argv) {
     seed = time(NULL);
 
     //Parsing command line options
-    while ((opt = getopt(argc, argv, "b:i:n:d:s:vh")) != -1) {
+    while ((opt = getopt(argc, argv, "b:i:n:d:s:t:m:vh")) != -1) {
         switch (opt) {
         case 'b': bits = (uint64_t) strtoull(optarg, NULL, 10); break;
-        case 'i': iters = (uint64_t) strtoull(optarg, NULL, 10); break;
+        case 'i':
+            iters = (uint64_t) strtoull(optarg, NULL, 10);
+            iters_set = true;
+            break;
+        case 'm':
+            if (strcmp(optarg, "bpsw") == 0) {
+                test = PRIME_BPSW;
+            } else if (strcmp(optarg, "mr") == 0) {
+                test = PRIME_MILLER_RABIN;
+            } else {
+                fprintf(stderr, "%s: Unknown primality test\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
         case 'n':
             pbfile = fopen(optarg, "w");
             //if file can't be opened, print to standard error
@@ -78,6 +105,10 @@ int main(int argc, char **argv) {
             }
             break;
         case 's': seed = (uint64_t) strtoull(optarg, NULL, 10); break;
+        case 't':
+            threads = (uint32_t) strtoul(optarg, NULL, 10);
+            threads_set = true;
+            break;
         case 'v': verbose = true; break;
         case 'h':
             usage(argv[0]);
@@ -94,11 +125,27 @@ int main(int argc, char **argv) {
     fchmod(pb_fd, S_IRUSR | S_IWUSR);
     fchmod(pv_fd, S_IRUSR | S_IWUSR);
 
+    //Baillie-PSW needs no random rounds unless asked for
+    if (test == PRIME_BPSW && !iters_set) {
+        iters = 0;
+    }
+
+    //loading the settings tuned for this key size
+    profile_t profile;
+    if (profile_load(&profile, profile_path(), bits)) {
+        profile_apply(&profile);
+        if (!threads_set) {
+            threads = profile.threads;
+        }
+    }
+
     //setting random state
-    randstate_init(seed);
+    randstate_init(&rs, seed);
+    set_prime_threads(threads);
+    set_prime_test(test);
 
     //create public and private keys
-    rsa_make_pub(p, q, n, e, bits, iters);
+    rsa_make_pub(p, q, n, e, bits, iters, &rs);
     rsa_make_priv(d, e, p, q);
 
     //get username
@@ -122,9 +169,14 @@ int main(int argc, char **argv) {
         gmp_printf("d (%zu bits) = %Zd\n", mpz_sizeinbase(d, 2), d);
     }
 
+    //allocation counts go to standard error, away from any output on standard output
+    if (verbose) {
+        arena_print_stats(stderr);
+    }
+
     //close all files, clear mpz_t variables, and clear randstate
     fclose(pbfile);
     fclose(pvfile);
-    randstate_clear();
+    randstate_clear(&rs);
     mpz_clears(p, q, d, e, n, username, s, NULL);
 }
@@ -0,0 +1,178 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <gmp.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "batch.h"
+#include "batchgcd.h"
+#include <unistd.h>
+
+//Names of the public key files a directory walk reads.
+#define PUB_SUFFIX ".pub"
+
+//Prints the usage message and synopsis to standard error.
+//Returns nothing.
+//
+//val: A string denoting the name of the file when called.
+void usage(char *val) {
+    fprintf(stderr, "SYNOPSIS\n");
+    fprintf(stderr, "   Checks that no two public keys share a prime factor, using batch GCD.\n");
+    fprintf(stderr, "   Every pair of keys that does is reported on stdout, with keys that\n");
+    fprintf(stderr, "   have the same modulus.\n\n");
+    fprintf(stderr, "USAGE\n");
+    fprintf(stderr, "   %s [OPTIONS] [files...]\n\n", val);
+    fprintf(stderr, "OPTIONS\n"
+                    "   -h              Display program help and usage.\n"
+                    "   -v              Display verbose program output.\n"
+                    "   -l listfile     Check every public key file listed in listfile, one per line.\n"
+                    "   -d dir          Check every public key file below dir, by its .pub name.\n"
+                    "   -g keys         Keys in one remainder tree (default: 16384). Smaller groups\n"
+                    "                   use less memory and more time.\n"
+                    "   -t threads      Groups worked on at once (default: online CPUs).\n");
+}
+
+//Reads the modulus of a public key file written by rsa_write_pub(). The file must have
+//all four fields (n, e, s and the user name), so a private key, which starts with the same
+//n, is not taken for a second copy of the public key.
+//Returns true if a modulus greater than 1 was read, else returns false.
+//
+//n: initialized mpz_t that stores the modulus.
+//pbname: path of the public key file.
+bool read_modulus(mpz_t n, const char *pbname) {
+    FILE *pbfile = fopen(pbname, "r");
+    if (pbfile == NULL) {
+        fprintf(stderr, "%s: No such file or directory\n", pbname);
+        return false;
+    }
+    mpz_t e, s;
+    char username[256];
+    mpz_inits(e, s, NULL);
+    bool ok = gmp_fscanf(pbfile, "%Zx %Zx %Zx %255s", n, e, s, username) == 4 && mpz_cmp_ui(n, 1) > 0;
+    if (!ok) {
+        fprintf(stderr, "%s: Invalid public key file\n", pbname);
+    }
+    mpz_clears(e, s, NULL);
+    fclose(pbfile);
+    return ok;
+}
+
+//Parses command-line options, reads every public key and reports the keys sharing factors.
+//Returns 0 if every key was read and none share a factor, else returns 1.
+//
+//argc: int that stores number of command-line options passed
+//argv stores command-line options passed
+int main(int argc, char **argv) {
+    int64_t opt;
+
+    //initializes verbose to false
+    bool verbose = false;
+
+    uint32_t threads = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+    size_t group = BATCH_GCD_GROUP;
+
+    filelist_t list;
+    filelist_init(&list);
+    size_t first;
+
+    //Parsing command line options
+    while ((opt = getopt(argc, argv, "l:d:g:t:vh")) != -1) {
+        switch (opt) {
+        case 'l':
+            if (!filelist_read(&list, optarg)) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'd':
+            //only public key files, not the private keys keygen writes next to them
+            first = list.count;
+            if (!filelist_walk(&list, optarg)) {
+                return EXIT_FAILURE;
+            }
+            filelist_filter_suffix(&list, first, PUB_SUFFIX, true);
+            break;
+        case 'g': group = (size_t) strtoull(optarg, NULL, 10); break;
+        case 't': threads = (uint32_t) strtoul(optarg, NULL, 10); break;
+        case 'v': verbose = true; break;
+        case 'h':
+            usage(argv[0]);
+            return EXIT_FAILURE;
+            break;
+        default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    for (int i = optind; i < argc; i += 1) {
+        if (!filelist_add(&list, argv[i])) {
+            fprintf(stderr, "Error: out of memory.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    //the moduli of every readable key, and the file each came from
+    mpz_t *n = (mpz_t *) malloc((list.count + 1) * sizeof(mpz_t));
+    size_t *files = (size_t *) malloc((list.count + 1) * sizeof(size_t));
+    if (n == NULL || files == NULL) {
+        fprintf(stderr, "Error: out of memory.\n");
+        return EXIT_FAILURE;
+    }
+    bool all = true;
+    size_t count = 0;
+    for (size_t i = 0; i < list.count; i += 1) {
+        mpz_init(n[count]);
+        if (read_modulus(n[count], list.paths[i])) {
+            files[count] = i;
+            count += 1;
+        } else {
+            mpz_clear(n[count]);
+            all = false;
+        }
+    }
+
+    mpz_t *g = (mpz_t *) malloc((count + 1) * sizeof(mpz_t));
+    for (size_t i = 0; i < count; i += 1) {
+        mpz_init(g[i]);
+    }
+    batch_gcd(g, n, count, group, threads);
+
+    //the few keys with a shared factor are paired up with plain gcds
+    size_t *weak = (size_t *) malloc((count + 1) * sizeof(size_t));
+    size_t weak_count = 0;
+    for (size_t i = 0; i < count; i += 1) {
+        if (mpz_cmp_ui(g[i], 1) != 0) {
+            weak[weak_count++] = i;
+        }
+    }
+    mpz_t factor;
+    mpz_init(factor);
+    for (size_t a = 0; a < weak_count; a += 1) {
+        for (size_t b = a + 1; b < weak_count; b += 1) {
+            char *first = list.paths[files[weak[a]]];
+            char *second = list.paths[files[weak[b]]];
+            mpz_gcd(factor, n[weak[a]], n[weak[b]]);
+            if (mpz_cmp(n[weak[a]], n[weak[b]]) == 0) {
+                printf("%s: same modulus as %s\n", first, second);
+            } else if (mpz_cmp_ui(factor, 1) != 0) {
+                printf("%s: shares a prime with %s\n", first, second);
+                if (verbose) {
+                    gmp_printf("p (%zu bits) = %Zx\n", mpz_sizeinbase(factor, 2), factor);
+                }
+            }
+        }
+    }
+
+    if (verbose) {
+        printf("keys = %zu, weak = %zu\n", count, weak_count);
+    }
+
+    //clear mpz_t variables
+    mpz_clear(factor);
+    for (size_t i = 0; i < count; i += 1) {
+        mpz_clears(n[i], g[i], NULL);
+    }
+    free(n);
+    free(g);
+    free(files);
+    free(weak);
+    filelist_clear(&list);
+    return (all && weak_count == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
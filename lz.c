@@ -0,0 +1,317 @@
+#include "lz.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//A small LZ77 codec in the style of LZ4. Compressed data is a list of sequences.
+//Each sequence is a token byte (literal count in the high nibble, match length - 4
+//in the low nibble, 15 meaning more length bytes follow), the literals, a 16 bit
+//little-endian match offset and the extra match length bytes. The last sequence
+//has only literals.
+
+#define MIN_MATCH 4
+#define HASH_BITS 12
+#define MAX_OFFSET 65535
+
+//Reads 4 bytes from p without alignment requirements.
+//Returns the bytes as a uint32_t.
+//
+//p: pointer to at least 4 readable bytes.
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+//Hashes 4 bytes of input into a match table index.
+//Returns the table index.
+//
+//v: the 4 bytes to hash.
+static uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+//Writes the extra bytes of a literal or match length.
+//Returns the new output position.
+//
+//op: output position.
+//len: length remaining after the 15 stored in the token.
+static uint8_t *put_length(uint8_t *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t) len;
+    return op;
+}
+
+//Reads the extra bytes of a literal or match length.
+//Returns false if the input ends in the middle of the length.
+//
+//src, srclen: compressed input.
+//ip: input position, advanced past the length bytes.
+//len: length to add the extra bytes to.
+static bool get_length(const uint8_t *src, size_t srclen, size_t *ip, size_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= srclen) {
+            return false;
+        }
+        b = src[*ip];
+        *ip += 1;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+//Calculates the largest compressed size of len bytes of input.
+//Returns the size in bytes.
+//
+//len: number of input bytes.
+size_t lz_bound(size_t len) {
+    return len + (len / 255) + 16;
+}
+
+//Compresses len bytes of src into dst.
+//Returns the compressed size.
+//
+//dst: output buffer with room for lz_bound(len) bytes.
+//src: input bytes.
+//len: number of input bytes, at most LZ_CHUNK_BYTES.
+size_t lz_compress(uint8_t *dst, const uint8_t *src, size_t len) {
+    int32_t table[1 << HASH_BITS];
+    uint8_t *op = dst;
+    uint8_t *token;
+    size_t anchor = 0;
+    size_t ip = 0;
+    size_t lit;
+
+    for (uint32_t i = 0; i < (1 << HASH_BITS); i += 1) {
+        table[i] = -1;
+    }
+
+    //matches are not started in the last few bytes so read32 stays in bounds
+    while (len >= 12 && ip < len - 12) {
+        uint32_t seq = read32(src + ip);
+        uint32_t h = hash4(seq);
+        int32_t ref = table[h];
+        table[h] = (int32_t) ip;
+
+        if (ref < 0 || ip - (size_t) ref > MAX_OFFSET || read32(src + ref) != seq) {
+            ip += 1;
+            continue;
+        }
+
+        //extending the match as far as it goes
+        size_t mlen = MIN_MATCH;
+        while (ip + mlen < len && src[ref + mlen] == src[ip + mlen]) {
+            mlen += 1;
+        }
+
+        //writing the literals before the match
+        lit = ip - anchor;
+        token = op++;
+        *token = (uint8_t) ((lit >= 15 ? 15 : lit) << 4);
+        if (lit >= 15) {
+            op = put_length(op, lit - 15);
+        }
+        memcpy(op, src + anchor, lit);
+        op += lit;
+
+        //writing the match
+        size_t offset = ip - (size_t) ref;
+        *op++ = (uint8_t) (offset & 0xFF);
+        *op++ = (uint8_t) (offset >> 8);
+        size_t m = mlen - MIN_MATCH;
+        *token |= (uint8_t) (m >= 15 ? 15 : m);
+        if (m >= 15) {
+            op = put_length(op, m - 15);
+        }
+
+        ip += mlen;
+        anchor = ip;
+    }
+
+    //the remaining input is written as literals
+    lit = len - anchor;
+    token = op++;
+    *token = (uint8_t) ((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15) {
+        op = put_length(op, lit - 15);
+    }
+    memcpy(op, src + anchor, lit);
+    op += lit;
+
+    return (size_t) (op - dst);
+}
+
+//Decompresses srclen bytes of src into exactly dstlen bytes of dst.
+//Returns false if the input is corrupt or does not decompress to dstlen bytes.
+//
+//dst: output buffer of dstlen bytes.
+//dstlen: decompressed size.
+//src: compressed input.
+//srclen: number of compressed bytes.
+bool lz_decompress(uint8_t *dst, size_t dstlen, const uint8_t *src, size_t srclen) {
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < srclen) {
+        uint8_t token = src[ip];
+        ip += 1;
+
+        //copying literals
+        size_t lit = token >> 4;
+        if (lit == 15 && !get_length(src, srclen, &ip, &lit)) {
+            return false;
+        }
+        if (lit > srclen - ip || lit > dstlen - op) {
+            return false;
+        }
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+
+        //the last sequence has no match
+        if (ip == srclen) {
+            break;
+        }
+
+        //copying the match, byte by byte since it may overlap itself
+        if (srclen - ip < 2) {
+            return false;
+        }
+        size_t offset = (size_t) src[ip] | ((size_t) src[ip + 1] << 8);
+        ip += 2;
+        size_t mlen = token & 0x0F;
+        if (mlen == 15 && !get_length(src, srclen, &ip, &mlen)) {
+            return false;
+        }
+        mlen += MIN_MATCH;
+        if (offset == 0 || offset > op || mlen > dstlen - op) {
+            return false;
+        }
+        for (size_t i = 0; i < mlen; i += 1) {
+            dst[op + i] = dst[op + i - offset];
+        }
+        op += mlen;
+    }
+    return op == dstlen;
+}
+
+//Writes the big-endian 32 bit value v to p.
+//Returns nothing (void).
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+//Reads a big-endian 32 bit value from p.
+//Returns the value.
+static uint32_t get32(const uint8_t *p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+//Compresses len bytes of src into a frame: the raw length, the stored length and
+//the stored bytes. Data that does not shrink is stored uncompressed.
+//Returns the size of the frame.
+//
+//dst: output buffer with room for LZ_HEADER_BYTES + lz_bound(len) bytes.
+//src: input bytes.
+//len: number of input bytes, at most LZ_CHUNK_BYTES.
+size_t lz_frame(uint8_t *dst, const uint8_t *src, size_t len) {
+    size_t stored = lz_compress(dst + LZ_HEADER_BYTES, src, len);
+
+    if (stored >= len) {
+        memcpy(dst + LZ_HEADER_BYTES, src, len);
+        stored = len;
+    }
+    put32(dst, (uint32_t) len);
+    put32(dst + 4, (uint32_t) stored);
+    return LZ_HEADER_BYTES + stored;
+}
+
+//Initializes a stream that decompresses frames as their bytes arrive.
+//Returns false if memory could not be allocated.
+//
+//stream: the stream to initialize.
+bool lz_stream_init(lz_stream_t *stream) {
+    stream->frame = (uint8_t *) malloc(LZ_HEADER_BYTES + LZ_CHUNK_BYTES);
+    stream->raw = (uint8_t *) malloc(LZ_CHUNK_BYTES);
+    stream->have = 0;
+    stream->need = LZ_HEADER_BYTES;
+    return stream->frame != NULL && stream->raw != NULL;
+}
+
+//Adds len bytes of framed data to the stream, passing each completed frame to sink.
+//Returns false if a frame is corrupt or the sink failed.
+//
+//stream: an initialized stream.
+//data: framed bytes in stream order, split anywhere.
+//len: number of bytes in data.
+//sink: function receiving decompressed data.
+//arg: passed to sink.
+bool lz_stream_write(lz_stream_t *stream, const uint8_t *data, size_t len, lz_sink_t sink, void *arg) {
+    while (len > 0) {
+        size_t take = stream->need - stream->have;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(stream->frame + stream->have, data, take);
+        stream->have += take;
+        data += take;
+        len -= take;
+
+        if (stream->have < stream->need) {
+            break;
+        }
+
+        uint32_t raw = get32(stream->frame);
+        uint32_t stored = get32(stream->frame + 4);
+        if (raw > LZ_CHUNK_BYTES || stored > raw) {
+            return false;
+        }
+
+        //the header is complete, now waiting for the stored bytes
+        if (stream->need == LZ_HEADER_BYTES && stored > 0) {
+            stream->need += stored;
+            continue;
+        }
+
+        uint8_t *body = stream->frame + LZ_HEADER_BYTES;
+        if (stored == raw) {
+            if (!sink(arg, body, raw)) {
+                return false;
+            }
+        } else {
+            if (!lz_decompress(stream->raw, raw, body, stored) || !sink(arg, stream->raw, raw)) {
+                return false;
+            }
+        }
+        stream->have = 0;
+        stream->need = LZ_HEADER_BYTES;
+    }
+    return true;
+}
+
+//Checks that the stream did not end in the middle of a frame.
+//Returns true if every frame was complete.
+//
+//stream: an initialized stream.
+bool lz_stream_done(lz_stream_t *stream) {
+    return stream->have == 0;
+}
+
+//Frees the memory of a stream.
+//Returns nothing (void).
+//
+//stream: an initialized stream.
+void lz_stream_clear(lz_stream_t *stream) {
+    free(stream->frame);
+    free(stream->raw);
+    stream->frame = NULL;
+    stream->raw = NULL;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Largest number of input bytes compressed as one frame (64 KiB).
+#define LZ_CHUNK_BYTES (1 << 16)
+
+//Bytes in a frame header: 32 bit raw length, then 32 bit stored length.
+#define LZ_HEADER_BYTES 8
+
+//Receives decompressed data. Returns false to stop with an error.
+typedef bool (*lz_sink_t)(void *arg, const uint8_t *data, size_t len);
+
+typedef struct {
+    uint8_t *frame;
+    uint8_t *raw;
+    size_t have;
+    size_t need;
+} lz_stream_t;
+
+size_t lz_bound(size_t len);
+
+size_t lz_compress(uint8_t *dst, const uint8_t *src, size_t len);
+
+bool lz_decompress(uint8_t *dst, size_t dstlen, const uint8_t *src, size_t srclen);
+
+size_t lz_frame(uint8_t *dst, const uint8_t *src, size_t len);
+
+bool lz_stream_init(lz_stream_t *stream);
+
+bool lz_stream_write(lz_stream_t *stream, const uint8_t *data, size_t len, lz_sink_t sink, void *arg);
+
+bool lz_stream_done(lz_stream_t *stream);
+
+void lz_stream_clear(lz_stream_t *stream);
@@ -5,8 +5,11 @@
 #include <gmp.h>
 #include <inttypes.h>
 #include "randstate.h"
+#include "arena.h"
 #include <stdlib.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 //The Pseudocode for the following functions was given in the Assignment 5 document.
 
@@ -47,6 +50,9 @@ void mod_inverse(mpz_t i, mpz_t a, mpz_t n) {
     mpz_t temp2;
     mpz_t q;
 
+    //the temporaries live in the arena until the end of the function
+    arena_mark_t mark = arena_begin();
+
     //Initializing mpz_t variables to 0.
     mpz_inits(r1, r2, t1, t2, temp1, temp2, q, NULL);
 
@@ -89,7 +95,8 @@ void mod_inverse(mpz_t i, mpz_t a, mpz_t n) {
         mpz_set(t2, temp1);
     }
 
-    //i = t1
+    //i = t1, written outside the arena since i outlives this function
+    arena_pause();
     mpz_set(i, t1);
 
     //if r1 > 1, execute below statement. else if t1 < 0, execute below statement.
@@ -99,19 +106,21 @@ void mod_inverse(mpz_t i, mpz_t a, mpz_t n) {
         mpz_add(t1, t1, n);
         mpz_set(i, t1);
     }
+    arena_resume();
 
     //clear mpz variables
     mpz_clears(r1, r2, t1, t2, temp1, temp2, q, NULL);
+    arena_end(mark);
 }
 
-//Calculates the modular exponentiation of base ^ exponent (mod n).
+//Calculates base ^ exponent (mod n) with right-to-left binary exponentiation.
 //Returns nothing (void).
 //
 //out: mpz_t variable to store results in. Must already be initialized.
 //base: mpz_t variable that is the base. Must already be initialized.
 //exponent: mpz_t variable that is the exponent. Must already be initialized.
 //modulus: mpz_t variable that is the modulus. Must already be initialized.
-void pow_mod(mpz_t out, mpz_t base, mpz_t exponent, mpz_t modulus) {
+static void pow_mod_binary(mpz_t out, mpz_t base, mpz_t exponent, mpz_t modulus) {
     //Declaring and initializing mpz_t variables.
     mpz_t v, p, exp;
     mpz_inits(v, p, exp, NULL);
@@ -145,21 +154,214 @@ void pow_mod(mpz_t out, mpz_t base, mpz_t exponent, mpz_t modulus) {
     mpz_clears(v, p, exp, NULL);
 }
 
+//Calculates base ^ exponent (mod n) with left-to-right sliding window exponentiation.
+//The odd powers base^1, base^3, ..., base^(2^window - 1) are precomputed, so each window
+//of up to window exponent bits costs one multiplication instead of one per set bit.
+//Returns nothing (void).
+//
+//out: mpz_t variable to store results in. Must already be initialized.
+//base: mpz_t variable that is the base. Must already be initialized.
+//exponent: non-negative mpz_t variable that is the exponent. Must already be initialized.
+//modulus: mpz_t variable that is the modulus. Must already be initialized.
+//window: window size in bits, from 1 to POW_WINDOW_MAX.
+static void pow_mod_window(mpz_t out, mpz_t base, mpz_t exponent, mpz_t modulus, uint32_t window) {
+    uint32_t size = 1u << (window - 1);
+    mpz_t table[1u << (POW_WINDOW_MAX - 1)];
+    mpz_t v, square;
+    mpz_inits(v, square, NULL);
+
+    //table[i] = base^(2i + 1) (mod modulus)
+    mpz_init(table[0]);
+    mpz_mod(table[0], base, modulus);
+    mpz_mul(square, table[0], table[0]);
+    mpz_mod(square, square, modulus);
+    for (uint32_t i = 1; i < size; i += 1) {
+        mpz_init(table[i]);
+        mpz_mul(table[i], table[i - 1], square);
+        mpz_mod(table[i], table[i], modulus);
+    }
+
+    mpz_set_ui(v, 1);
+    int64_t i = (int64_t) mpz_sizeinbase(exponent, 2) - 1;
+    if (mpz_sgn(exponent) == 0) {
+        i = -1;
+    }
+    while (i >= 0) {
+        if (!mpz_tstbit(exponent, (mp_bitcnt_t) i)) {
+            //v = v^2
+            mpz_mul(v, v, v);
+            mpz_mod(v, v, modulus);
+            i -= 1;
+            continue;
+        }
+
+        //the longest window of at most window bits that ends in a set bit
+        int64_t low = i - (int64_t) window + 1;
+        if (low < 0) {
+            low = 0;
+        }
+        while (!mpz_tstbit(exponent, (mp_bitcnt_t) low)) {
+            low += 1;
+        }
+        uint32_t value = 0;
+        for (int64_t b = i; b >= low; b -= 1) {
+            value = (value << 1) | (uint32_t) mpz_tstbit(exponent, (mp_bitcnt_t) b);
+            //v = v^2 for every bit of the window
+            mpz_mul(v, v, v);
+            mpz_mod(v, v, modulus);
+        }
+        //v = v * base^value
+        mpz_mul(v, v, table[value >> 1]);
+        mpz_mod(v, v, modulus);
+        i = low - 1;
+    }
+
+    //out = v
+    mpz_set(out, v);
+    for (uint32_t j = 0; j < size; j += 1) {
+        mpz_clear(table[j]);
+    }
+    mpz_clears(v, square, NULL);
+}
+
+//Method and window size pow_mod() uses.
+static pow_method_t pow_method = POW_BINARY;
+static uint32_t pow_window = 4;
+
+//Selects the method pow_mod() uses. Meant to be called once at startup, before threads start.
+//Returns nothing (void).
+//
+//method: POW_BINARY, POW_WINDOW or POW_GMP.
+//window: window size in bits for POW_WINDOW, clamped to [1, POW_WINDOW_MAX].
+void set_pow_mod(pow_method_t method, uint32_t window) {
+    pow_method = method;
+    pow_window = (window < 1) ? 1 : (window > POW_WINDOW_MAX) ? POW_WINDOW_MAX : window;
+}
+
+//Calculates the modular exponentiation of base ^ exponent (mod n)
+//with the method selected by set_pow_mod().
+//Returns nothing (void).
+//
+//out: mpz_t variable to store results in. Must already be initialized.
+//base: mpz_t variable that is the base. Must already be initialized.
+//exponent: mpz_t variable that is the exponent. Must already be initialized.
+//modulus: mpz_t variable that is the modulus. Must already be initialized.
+void pow_mod(mpz_t out, mpz_t base, mpz_t exponent, mpz_t modulus) {
+    //every temporary of one exponentiation comes from the arena
+    arena_mark_t mark = arena_begin();
+    mpz_t v;
+    mpz_init(v);
+
+    switch (pow_method) {
+    case POW_WINDOW: pow_mod_window(v, base, exponent, modulus, pow_window); break;
+    case POW_GMP: mpz_powm(v, base, exponent, modulus); break;
+    default: pow_mod_binary(v, base, exponent, modulus); break;
+    }
+
+    //out = v, outside the arena since out outlives the scope
+    arena_pause();
+    mpz_set(out, v);
+    arena_resume();
+    mpz_clear(v);
+    arena_end(mark);
+}
+
+//Initializes an exponentiation that runs a bounded number of steps at a time, for callers
+//that can only spend a bounded slice of time at once.
+//Returns nothing (void).
+//
+//ps: exponentiation to initialize.
+void pow_step_init(pow_step_t *ps) {
+    mpz_inits(ps->v, ps->base, ps->exponent, ps->modulus, NULL);
+    ps->bit = -1;
+}
+
+//Starts a step-limited exponentiation of base ^ exponent (mod modulus). The work is
+//left-to-right binary exponentiation, one step per exponent bit.
+//Returns nothing (void).
+//
+//ps: exponentiation to start. It must be initialized with pow_step_init().
+//base: mpz_t variable that is the base.
+//exponent: non-negative mpz_t variable that is the exponent.
+//modulus: mpz_t variable that is the modulus.
+void pow_step_start(pow_step_t *ps, mpz_t base, mpz_t exponent, mpz_t modulus) {
+    //the state outlives any scope of the caller, and v never needs to grow
+    arena_pause();
+    mpz_set(ps->modulus, modulus);
+    mpz_mod(ps->base, base, modulus);
+    mpz_set(ps->exponent, exponent);
+    mpz_realloc2(ps->v, 2 * mpz_sizeinbase(modulus, 2));
+    mpz_set_ui(ps->v, 1);
+    arena_resume();
+    ps->bit = (mpz_sgn(exponent) == 0) ? -1 : (int64_t) mpz_sizeinbase(exponent, 2) - 1;
+}
+
+//Runs an exponentiation for at most *steps exponent bits.
+//Returns true once the exponentiation is finished.
+//
+//ps: a started exponentiation.
+//steps: the steps left in this slice, reduced by the steps taken.
+bool pow_step_run(pow_step_t *ps, uint64_t *steps) {
+    //the work is done in a temporary, since v must survive the end of the scope
+    arena_mark_t mark = arena_begin();
+    mpz_t t;
+    mpz_init(t);
+    mpz_set(t, ps->v);
+    while (ps->bit >= 0 && *steps > 0) {
+        //t = t^2 (mod modulus), then t = t * base (mod modulus) for a set bit
+        mpz_mul(t, t, t);
+        mpz_mod(t, t, ps->modulus);
+        if (mpz_tstbit(ps->exponent, (mp_bitcnt_t) ps->bit)) {
+            mpz_mul(t, t, ps->base);
+            mpz_mod(t, t, ps->modulus);
+        }
+        ps->bit -= 1;
+        *steps -= 1;
+    }
+
+    //v = t, outside the arena
+    arena_pause();
+    mpz_set(ps->v, t);
+    arena_resume();
+    mpz_clear(t);
+    arena_end(mark);
+    return ps->bit < 0;
+}
+
+//Reads the result of a finished exponentiation.
+//Returns nothing (void).
+//
+//out: mpz_t variable to store base ^ exponent (mod modulus) in.
+//ps: a finished exponentiation.
+void pow_step_result(mpz_t out, pow_step_t *ps) {
+    mpz_set(out, ps->v);
+}
+
+//Frees the memory of a step-limited exponentiation.
+//Returns nothing (void).
+//
+//ps: an initialized exponentiation.
+void pow_step_clear(pow_step_t *ps) {
+    mpz_clears(ps->v, ps->base, ps->exponent, ps->modulus, NULL);
+}
+
 //Tests if a number is prime using the Miller-Rabin test.
 //Returns true if the number is indicated as prime.
 //Returns false if the number is indicated as composite.
 //
 //n: an mpz_t variable that is tested for primality. It must already be initialized.
 //iters: a uint64_t that indicates the number of iterations that the Miller-rabin should be run.
-bool is_prime(mpz_t n, uint64_t iters) {
+//rs: random state the witnesses are drawn from.
+bool is_prime(mpz_t n, uint64_t iters, randstate_t *rs) {
+    //the temporaries live in the arena until the function returns
+    arena_mark_t mark = arena_begin();
+
     //Declaring and initializing mpz_t variables
-    mpz_t s, r, j, y, roll, two, temp;
-    mpz_inits(s, r, j, y, roll, temp, two, NULL);
+    mpz_t s, r, j, y, roll, temp;
+    mpz_inits(s, r, j, y, roll, temp, NULL);
 
     //r = n - 1
     mpz_sub_ui(r, n, 1);
-    //two = 2
-    mpz_set_ui(two, 2);
     //temp = n (mod 2)
     mpz_mod_ui(temp, n, 2);
 
@@ -168,12 +370,14 @@ bool is_prime(mpz_t n, uint64_t iters) {
 
     // if n < 2 or temp = 0 and n != 2, clear mpz_t variables and return false.
     if ((mpz_cmp_ui(n, 2) < 0) || ((mpz_cmp_ui(temp, 0) == 0) && (mpz_cmp_ui(n, 2) != 0))) {
-        mpz_clears(s, r, j, y, roll, temp, two, NULL);
+        mpz_clears(s, r, j, y, roll, temp, NULL);
+        arena_end(mark);
         return false;
     }
     // if n = 2, temp or n = 3, clear mpz_t variables and return true.
     if ((mpz_cmp_ui(n, 3) == 0) || (mpz_cmp_ui(n, 2) == 0)) {
-        mpz_clears(s, r, j, y, roll, temp, two, NULL);
+        mpz_clears(s, r, j, y, roll, temp, NULL);
+        arena_end(mark);
         return true;
     }
 
@@ -191,7 +395,7 @@ bool is_prime(mpz_t n, uint64_t iters) {
     for (uint64_t i = 1; i < iters; i += 1) {
         //Generating a random number from [2 to n-1]
         mpz_sub_ui(temp, n, 3);
-        mpz_urandomm(roll, state, temp);
+        randstate_urandomm(roll, rs, temp);
         mpz_add_ui(temp, temp, 1);
         mpz_mod(roll, roll, temp);
         mpz_add_ui(roll, roll, 2);
@@ -206,50 +410,324 @@ bool is_prime(mpz_t n, uint64_t iters) {
             mpz_set_ui(j, 1);
             //Loop runs while j <= s and y != temp
             while ((mpz_cmp(j, s) <= 0) && (mpz_cmp(y, temp) != 0)) {
-                pow_mod(y, y, two, n);
+                //y = y^2 (mod n)
+                mpz_mul(y, y, y);
+                mpz_mod(y, y, n);
                 if (mpz_cmp_ui(y, 1) == 0) {
-                    mpz_clears(s, r, j, y, roll, temp, two, NULL);
+                    mpz_clears(s, r, j, y, roll, temp, NULL);
+                    arena_end(mark);
                     //The number is composite.
                     return false;
                 }
                 mpz_add_ui(j, j, 1);
             }
             if (mpz_cmp(y, temp) != 0) {
-                mpz_clears(s, r, j, y, roll, temp, two, NULL);
+                mpz_clears(s, r, j, y, roll, temp, NULL);
+                arena_end(mark);
                 //The number is composite.
                 return false;
             }
         }
     }
     //clearing mpz_t variables
-    mpz_clears(s, r, j, y, roll, temp, two, NULL);
+    mpz_clears(s, r, j, y, roll, temp, NULL);
+    arena_end(mark);
     //The number is prime.
     return true;
 }
-//Generates a new prime number which is stored in p.
+//Primes below 256, used for trial division before the probable prime tests.
+static const uint32_t small_primes[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47,
+    53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131, 137, 139, 149, 151,
+    157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223, 227, 229, 233, 239, 241, 251 };
+
+//Runs one strong probable prime (Miller-Rabin) test of n to base a.
+//Returns true if n is a strong probable prime to base a.
+//
+//n: odd mpz_t to test, greater than 3.
+//a: base in [2, n - 2].
+//r: odd mpz_t with n - 1 = r * 2^s.
+//s: power of two in n - 1.
+static bool strong_test(mpz_t n, mpz_t a, mpz_t r, uint64_t s) {
+    mpz_t y, nm1;
+    mpz_inits(y, nm1, NULL);
+    mpz_sub_ui(nm1, n, 1);
+
+    //y = a^r (mod n)
+    pow_mod(y, a, r, n);
+    bool probable = (mpz_cmp_ui(y, 1) == 0) || (mpz_cmp(y, nm1) == 0);
+
+    for (uint64_t j = 1; j < s && !probable; j += 1) {
+        //y = y^2 (mod n)
+        mpz_mul(y, y, y);
+        mpz_mod(y, y, n);
+        if (mpz_cmp_ui(y, 1) == 0) {
+            break;
+        }
+        probable = mpz_cmp(y, nm1) == 0;
+    }
+    mpz_clears(y, nm1, NULL);
+    return probable;
+}
+
+//Sets x = x / 2 (mod n) for odd n and x in [0, n - 1].
 //Returns nothing (void).
 //
-//p: an mpz_t variable that holds a prime number.
-//bits: a uint64_t specifying the minimum number of bits that p should be.
-//iters: a uint64_t specifying the number of iterations to run is_prime() with.
-void make_prime(mpz_t p, uint64_t bits, uint64_t iters) {
+//x: mpz_t to halve.
+//n: odd modulus.
+static void half_mod(mpz_t x, mpz_t n) {
+    if (mpz_odd_p(x)) {
+        mpz_add(x, x, n);
+    }
+    mpz_fdiv_q_2exp(x, x, 1);
+}
+
+//Runs the strong Lucas probable prime test with Selfridge's parameters:
+//D is the first of 5, -7, 9, -11, ... with Jacobi(D/n) = -1, P = 1 and Q = (1 - D)/4.
+//Returns true if n is a strong Lucas probable prime.
+//
+//n: odd mpz_t to test that is not a perfect square, greater than 3.
+static bool strong_lucas_test(mpz_t n) {
+    mpz_t d, u, v, qk, t, big_d;
+    mpz_inits(d, u, v, qk, t, big_d, NULL);
+
+    //Finding D
+    int64_t dd = 5;
+    while (true) {
+        mpz_set_si(big_d, dd);
+        int jacobi = mpz_jacobi(big_d, n);
+        if (jacobi == -1) {
+            break;
+        }
+        //a D sharing a factor with n (other than n itself) shows n is composite
+        if (jacobi == 0 && mpz_cmpabs_ui(n, (unsigned long) (dd < 0 ? -dd : dd)) != 0) {
+            mpz_clears(d, u, v, qk, t, big_d, NULL);
+            return false;
+        }
+        dd = (dd > 0) ? -(dd + 2) : -(dd - 2);
+    }
+    int64_t q = (1 - dd) / 4;
+
+    //n + 1 = d * 2^s with d odd
+    mpz_add_ui(d, n, 1);
+    uint64_t s = mpz_scan1(d, 0);
+    mpz_fdiv_q_2exp(d, d, s);
+
+    //U_1 = 1, V_1 = P = 1, qk = Q^1, then walking the bits of d from the top
+    mpz_set_ui(u, 1);
+    mpz_set_ui(v, 1);
+    mpz_set_si(qk, q);
+    mpz_mod(qk, qk, n);
+    for (int64_t bit = (int64_t) mpz_sizeinbase(d, 2) - 2; bit >= 0; bit -= 1) {
+        //U_2k = U_k * V_k, V_2k = V_k^2 - 2 Q^k
+        mpz_mul(u, u, v);
+        mpz_mod(u, u, n);
+        mpz_mul(v, v, v);
+        mpz_submul_ui(v, qk, 2);
+        mpz_mod(v, v, n);
+        mpz_mul(qk, qk, qk);
+        mpz_mod(qk, qk, n);
+
+        if (mpz_tstbit(d, (mp_bitcnt_t) bit)) {
+            //U_k+1 = (P U_k + V_k)/2, V_k+1 = (D U_k + P V_k)/2
+            mpz_add(t, u, v);
+            mpz_mul(v, u, big_d);
+            mpz_add(v, v, t);
+            mpz_sub(v, v, u);
+            mpz_mod(v, v, n);
+            half_mod(v, n);
+            mpz_mod(u, t, n);
+            half_mod(u, n);
+            mpz_mul_si(qk, qk, q);
+            mpz_mod(qk, qk, n);
+        }
+    }
+
+    //n is a strong Lucas probable prime if U_d = 0 or V_(d 2^r) = 0 for some r < s
+    bool probable = (mpz_sgn(u) == 0) || (mpz_sgn(v) == 0);
+    for (uint64_t r = 1; r < s && !probable; r += 1) {
+        mpz_mul(v, v, v);
+        mpz_submul_ui(v, qk, 2);
+        mpz_mod(v, v, n);
+        mpz_mul(qk, qk, qk);
+        mpz_mod(qk, qk, n);
+        probable = mpz_sgn(v) == 0;
+    }
+
+    mpz_clears(d, u, v, qk, t, big_d, NULL);
+    return probable;
+}
+
+//Tests if a number is prime using the Baillie-PSW test: trial division by small primes,
+//a strong probable prime test to base 2 and a strong Lucas test, followed by iters
+//Miller-Rabin rounds with random bases. No composite is known to pass Baillie-PSW.
+//Returns true if the number is indicated as prime.
+//Returns false if the number is indicated as composite.
+//
+//n: an mpz_t variable that is tested for primality. It must already be initialized.
+//iters: a uint64_t with the number of extra Miller-Rabin rounds (may be 0).
+//rs: random state the extra bases are drawn from.
+bool is_prime_bpsw(mpz_t n, uint64_t iters, randstate_t *rs) {
+    if (mpz_cmp_ui(n, 2) < 0) {
+        return false;
+    }
+    for (uint32_t i = 0; i < sizeof(small_primes) / sizeof(small_primes[0]); i += 1) {
+        if (mpz_cmp_ui(n, small_primes[i]) == 0) {
+            return true;
+        }
+        if (mpz_divisible_ui_p(n, small_primes[i])) {
+            return false;
+        }
+    }
+    //the search for D never ends for perfect squares
+    if (mpz_perfect_square_p(n)) {
+        return false;
+    }
+
+    //the temporaries live in the arena until the function returns
+    arena_mark_t mark = arena_begin();
+
+    //Declaring and initializing mpz_t variables
+    mpz_t r, a, range;
+    mpz_inits(r, a, range, NULL);
+
+    //n - 1 = r * 2^s
+    mpz_sub_ui(r, n, 1);
+    uint64_t s = mpz_scan1(r, 0);
+    mpz_fdiv_q_2exp(r, r, s);
+
+    mpz_set_ui(a, 2);
+    bool probable = strong_test(n, a, r, s) && strong_lucas_test(n);
+
+    //extra rounds with random bases from [2, n - 2]
+    mpz_sub_ui(range, n, 3);
+    for (uint64_t i = 0; i < iters && probable; i += 1) {
+        randstate_urandomm(a, rs, range);
+        mpz_add_ui(a, a, 2);
+        probable = strong_test(n, a, r, s);
+    }
+
+    //clearing mpz_t variables
+    mpz_clears(r, a, range, NULL);
+    arena_end(mark);
+    return probable;
+}
+
+//Test make_prime() confirms candidates with.
+static prime_test_t prime_test = PRIME_MILLER_RABIN;
+
+//Sets the test make_prime() confirms candidates with.
+//Returns nothing (void).
+//
+//test: PRIME_MILLER_RABIN or PRIME_BPSW.
+void set_prime_test(prime_test_t test) {
+    prime_test = test;
+}
+
+//Number of threads make_prime() tests candidates with.
+static uint32_t prime_threads = 1;
+
+//Sets the number of threads make_prime() tests candidates with.
+//The primes found do not depend on it.
+//Returns nothing (void).
+//
+//threads: number of threads (at least 1).
+void set_prime_threads(uint32_t threads) {
+    prime_threads = (threads == 0) ? 1 : threads;
+}
+
+//Candidate search shared by the make_prime() threads.
+typedef struct {
+    randstate_t family;
+    uint64_t bits;
+    uint64_t iters;
+    atomic_uint_fast64_t next;
+    atomic_uint_fast64_t best;
+    pthread_mutex_t lock;
+    mpz_t prime;
+} search_t;
+
+//Tests candidates in index order until a prime with a lower index has been found.
+//Candidate j and its Miller-Rabin witnesses come from stream j of the family,
+//so the lowest prime index, and the prime, are the same for any number of threads.
+//Returns NULL.
+//
+//arg: pointer to the shared search_t.
+static void *search_primes(void *arg) {
+    search_t *search = (search_t *) arg;
+    randstate_t rs;
+
     //Declaring and initializing mpz_t variables.
+    //n gets its memory here since it outlives each candidate's arena scope
     mpz_t n, offset;
-    mpz_inits(n, offset, NULL);
-
-    bool test_prime = false;
+    mpz_init2(n, search->bits + 1);
+    mpz_init(offset);
+    //offset = 2^bits
+    mpz_ui_pow_ui(offset, 2, search->bits);
 
-    while (test_prime == false) {
-        //Generating a random number from 0 to n^(bits) - 1
-        mpz_urandomb(n, state, bits);
-        //Adding an offset of 2^n bits to n
-        mpz_ui_pow_ui(offset, 2, bits);
+    while (true) {
+        uint64_t j = atomic_fetch_add(&search->next, 1);
+        if (j >= atomic_load(&search->best)) {
+            break;
+        }
+        randstate_split(&rs, &search->family, j);
+        arena_mark_t mark = arena_begin();
+        //Generating a random number from 2^bits to 2^(bits+1) - 1
+        randstate_urandomb(n, &rs, search->bits);
         mpz_add(n, n, offset);
         //Checking if new number is prime
-        test_prime = is_prime(n, iters);
+        bool prime = (prime_test == PRIME_BPSW) ? is_prime_bpsw(n, search->iters, &rs)
+                                                : is_prime(n, search->iters, &rs);
+        arena_end(mark);
+        if (prime) {
+            pthread_mutex_lock(&search->lock);
+            if (j < atomic_load(&search->best)) {
+                atomic_store(&search->best, j);
+                mpz_set(search->prime, n);
+            }
+            pthread_mutex_unlock(&search->lock);
+        }
     }
-    //Set p = n
-    mpz_set(p, n);
     //clear mpz_t variables.
     mpz_clears(n, offset, NULL);
+    return NULL;
+}
+
+//Generates a new prime number which is stored in p.
+//Returns nothing (void).
+//
+//p: an mpz_t variable that holds a prime number.
+//bits: a uint64_t specifying the minimum number of bits that p should be.
+//iters: a uint64_t specifying the number of iterations to run is_prime() with,
+//or the number of extra rounds after is_prime_bpsw().
+//rs: random state. One number is drawn from it to select the candidate streams.
+void make_prime(mpz_t p, uint64_t bits, uint64_t iters, randstate_t *rs) {
+    search_t search;
+    pthread_t *workers = (pthread_t *) calloc(prime_threads, sizeof(pthread_t));
+    uint32_t started = 0;
+
+    randstate_split(&search.family, rs, randstate_u64(rs));
+    search.bits = bits;
+    search.iters = iters;
+    atomic_init(&search.next, 0);
+    atomic_init(&search.best, UINT64_MAX);
+    pthread_mutex_init(&search.lock, NULL);
+    mpz_init(search.prime);
+
+    //the calling thread searches too
+    for (uint32_t i = 1; workers != NULL && i < prime_threads; i += 1) {
+        if (pthread_create(&workers[started], NULL, search_primes, &search) == 0) {
+            started += 1;
+        }
+    }
+    search_primes(&search);
+    for (uint32_t i = 0; i < started; i += 1) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    //Set p = the prime with the lowest index
+    mpz_set(p, search.prime);
+    mpz_clear(search.prime);
+    pthread_mutex_destroy(&search.lock);
+    randstate_clear(&search.family);
 }
@@ -4,13 +4,48 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <gmp.h>
+#include "randstate.h"
+
+typedef enum { PRIME_MILLER_RABIN, PRIME_BPSW } prime_test_t;
+
+typedef enum { POW_BINARY, POW_WINDOW, POW_GMP } pow_method_t;
+
+//Largest window size for POW_WINDOW.
+#define POW_WINDOW_MAX 8
+
+//An exponentiation that runs a bounded number of steps at a time.
+typedef struct {
+    mpz_t v;
+    mpz_t base;
+    mpz_t exponent;
+    mpz_t modulus;
+    int64_t bit;
+} pow_step_t;
 
 void gcd(mpz_t d, mpz_t a, mpz_t b);
 
 void mod_inverse(mpz_t i, mpz_t a, mpz_t n);
 
+void set_pow_mod(pow_method_t method, uint32_t window);
+
 void pow_mod(mpz_t out, mpz_t base, mpz_t exponent, mpz_t modulus);
 
-bool is_prime(mpz_t n, uint64_t iters);
+void pow_step_init(pow_step_t *ps);
+
+void pow_step_start(pow_step_t *ps, mpz_t base, mpz_t exponent, mpz_t modulus);
+
+bool pow_step_run(pow_step_t *ps, uint64_t *steps);
+
+void pow_step_result(mpz_t out, pow_step_t *ps);
+
+void pow_step_clear(pow_step_t *ps);
+
+bool is_prime(mpz_t n, uint64_t iters, randstate_t *rs);
+
+bool is_prime_bpsw(mpz_t n, uint64_t iters, randstate_t *rs);
+
+void set_prime_test(prime_test_t test);
+
+void set_prime_threads(uint32_t threads);
 
-void make_prime(mpz_t p, uint64_t bits, uint64_t iters);
+void make_prime(mpz_t p, uint64_t bits, uint64_t iters, randstate_t *rs);
@@ -0,0 +1,104 @@
+#include "profile.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "numtheory.h"
+#include "rsa.h"
+
+//A tuning profile is a text file written by rsa-tune with one line per key size:
+//    bits method window threads batch
+//Blank lines and lines starting with '#' are ignored. Lines without the record batch size,
+//from before it was tuned, get RECORD_BATCH_BLOCKS.
+
+static const char *method_names[] = { "binary", "window", "gmp" };
+
+//Finds the profile file.
+//Returns the value of the RSA_TUNE environment variable, or PROFILE_DEFAULT_PATH.
+const char *profile_path(void) {
+    const char *path = getenv("RSA_TUNE");
+    return (path != NULL && path[0] != '\0') ? path : PROFILE_DEFAULT_PATH;
+}
+
+//Names a pow_mod() method as it is written in profiles.
+//Returns the name.
+//
+//method: the method to name.
+const char *profile_method_name(pow_method_t method) {
+    return method_names[method];
+}
+
+//Loads the settings tuned for the key size closest to bits.
+//Returns false if the profile does not exist or has no valid entries.
+//
+//profile: stores the settings found.
+//path: profile file to read.
+//bits: key size the settings are wanted for.
+bool profile_load(profile_t *profile, const char *path, uint64_t bits) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool found = false;
+    uint64_t best = UINT64_MAX;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        profile_t entry;
+        char name[32];
+
+        entry.batch = RECORD_BATCH_BLOCKS;
+        if (line[0] == '#'
+            || sscanf(line, "%" SCNu64 " %31s %" SCNu32 " %" SCNu32 " %" SCNu32, &entry.bits, name,
+                   &entry.window, &entry.threads, &entry.batch)
+                   < 4) {
+            continue;
+        }
+        bool known = false;
+        for (uint32_t m = POW_BINARY; m <= POW_GMP; m += 1) {
+            if (strcmp(name, method_names[m]) == 0) {
+                entry.method = (pow_method_t) m;
+                known = true;
+            }
+        }
+        uint64_t distance = (entry.bits > bits) ? entry.bits - bits : bits - entry.bits;
+        if (known && distance < best) {
+            *profile = entry;
+            best = distance;
+            found = true;
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+//Writes tuned settings for several key sizes to a profile file.
+//Returns false if the file could not be written.
+//
+//profiles: the settings, one entry per key size.
+//count: number of entries.
+//path: profile file to write.
+bool profile_save(profile_t profiles[], size_t count, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "# rsa-tune profile\n# bits method window threads batch\n");
+    for (size_t i = 0; i < count; i += 1) {
+        fprintf(file, "%" PRIu64 " %s %" PRIu32 " %" PRIu32 " %" PRIu32 "\n", profiles[i].bits,
+            method_names[profiles[i].method], profiles[i].window, profiles[i].threads, profiles[i].batch);
+    }
+    return fclose(file) == 0;
+}
+
+//Makes pow_mod(), make_prime() and record mode use the settings of a profile.
+//Returns nothing (void).
+//
+//profile: loaded settings.
+void profile_apply(profile_t *profile) {
+    set_pow_mod(profile->method, profile->window);
+    set_prime_threads(profile->threads);
+    set_record_batch(profile->batch);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "numtheory.h"
+
+//Profile file used when RSA_TUNE is not set.
+#define PROFILE_DEFAULT_PATH "rsa.tune"
+
+//Tuned settings for one key size.
+typedef struct {
+    uint64_t bits;
+    pow_method_t method;
+    uint32_t window;
+    uint32_t threads;
+    uint32_t batch;
+} profile_t;
+
+const char *profile_path(void);
+
+const char *profile_method_name(pow_method_t method);
+
+bool profile_load(profile_t *profile, const char *path, uint64_t bits);
+
+bool profile_save(profile_t profiles[], size_t count, const char *path);
+
+void profile_apply(profile_t *profile);
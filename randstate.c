@@ -1,36 +1,136 @@
+#include "randstate.h"
 #include <stdint.h>
 #include <gmp.h>
-#include "randstate.h"
 #include <stdlib.h>
-#include <stdio.h>
-#include <inttypes.h>
+#include <string.h>
+#include "chacha.h"
+
+//Words randstate_urandomb() draws into its stack buffer at a time.
+#define URANDOMB_WORDS 256
 
-//Initializing global variable state.
-gmp_randstate_t state;
+//Mixes a 64 bit value (the SplitMix64 finalizer).
+//Returns the mixed value.
+//
+//x: value to mix.
+static uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
 
-//Initializes a global variable state for gmp random functions
-//using the Mersenne Twister algorithm.
-//Function also seeds srandom().
+//Initializes a random state from a seed. The same seed always gives the same stream.
 //Returns nothing (void).
 //
+//rs: the random state to initialize.
 //seed: Accepts a uint64_t seed argument.
-//Function should only be called once.
-void randstate_init(uint64_t seed) {
+void randstate_init(randstate_t *rs, uint64_t seed) {
+    //expanding the seed into a 256 bit key
+    uint64_t x = seed;
+    for (uint32_t i = 0; i < CHACHA_KEY_WORDS; i += 2) {
+        x = mix64(x);
+        rs->key[i] = (uint32_t) x;
+        rs->key[i + 1] = (uint32_t) (x >> 32);
+    }
+    rs->stream = 0;
+    rs->counter = 0;
+    rs->used = CHACHA_BLOCK_WORDS;
+}
 
-    //Initializing state for Mersenne Twister algorithm.
-    gmp_randinit_mt(state);
+//Derives an independent stream from a parent state. The child depends only on the
+//parent's seed, the parent's stream and index, so work split across threads by index
+//gives the same results for any number of threads.
+//Returns nothing (void).
+//
+//child: the random state to initialize.
+//parent: an initialized random state. It is not advanced.
+//index: selects the child stream.
+void randstate_split(randstate_t *child, const randstate_t *parent, uint64_t index) {
+    memcpy(child->key, parent->key, sizeof(child->key));
+    child->stream = mix64(parent->stream ^ mix64(index));
+    child->counter = 0;
+    child->used = CHACHA_BLOCK_WORDS;
+}
 
-    //Seeding the initial value for state.
-    gmp_randseed_ui(state, seed);
+//Skips ahead in the stream without generating the skipped output.
+//Returns nothing (void).
+//
+//rs: an initialized random state.
+//blocks: number of 64 byte keystream blocks to skip.
+void randstate_jump(randstate_t *rs, uint64_t blocks) {
+    rs->counter += blocks;
+    rs->used = CHACHA_BLOCK_WORDS;
+}
 
-    //Seeding for calls to random().
-    srandom(seed);
+//Generates a random 64 bit number.
+//Returns the number.
+//
+//rs: an initialized random state.
+uint64_t randstate_u64(randstate_t *rs) {
+    if (rs->used + 2 > CHACHA_BLOCK_WORDS) {
+        chacha_block(rs->block, rs->key, rs->counter, rs->stream);
+        rs->counter += 1;
+        rs->used = 0;
+    }
+    uint64_t r = (uint64_t) rs->block[rs->used] | ((uint64_t) rs->block[rs->used + 1] << 32);
+    rs->used += 2;
+    return r;
+}
+
+//Generates a uniformly random number in [0, 2^bits - 1].
+//The words are drawn least significant first, a stack buffer at a time.
+//Returns nothing (void).
+//
+//r: initialized mpz_t to store the number in.
+//rs: an initialized random state.
+//bits: number of random bits.
+void randstate_urandomb(mpz_t r, randstate_t *rs, uint64_t bits) {
+    uint64_t words = (bits + 63) / 64;
+    uint64_t buf[URANDOMB_WORDS];
+
+    //numbers up to URANDOMB_WORDS words, which covers every key size, are imported at once
+    if (words <= URANDOMB_WORDS) {
+        for (uint64_t i = 0; i < words; i += 1) {
+            buf[i] = randstate_u64(rs);
+        }
+        mpz_import(r, words, -1, sizeof(uint64_t), 0, 0, buf);
+        mpz_fdiv_r_2exp(r, r, bits);
+        return;
+    }
+
+    mpz_t part;
+    mpz_init(part);
+    mpz_set_ui(r, 0);
+    for (uint64_t first = 0; first < words; first += URANDOMB_WORDS) {
+        uint64_t count = (words - first < URANDOMB_WORDS) ? words - first : URANDOMB_WORDS;
+        for (uint64_t i = 0; i < count; i += 1) {
+            buf[i] = randstate_u64(rs);
+        }
+        mpz_import(part, count, -1, sizeof(uint64_t), 0, 0, buf);
+        mpz_mul_2exp(part, part, 64 * first);
+        mpz_add(r, r, part);
+    }
+    mpz_clear(part);
+    mpz_fdiv_r_2exp(r, r, bits);
+}
+
+//Generates a uniformly random number in [0, n - 1] by rejection sampling.
+//Returns nothing (void).
+//
+//r: initialized mpz_t to store the number in.
+//rs: an initialized random state.
+//n: upper bound, must be positive.
+void randstate_urandomm(mpz_t r, randstate_t *rs, mpz_t n) {
+    uint64_t bits = mpz_sizeinbase(n, 2);
+    do {
+        randstate_urandomb(r, rs, bits);
+    } while (mpz_cmp(r, n) >= 0);
 }
 
-//Clears the created random state (state must already have been initialized).
+//Clears the key and buffered output of a random state.
 //Returns nothing (void).
 //
-//Accepts no arguments (void).
-void randstate_clear(void) {
-    gmp_randclear(state);
+//rs: an initialized random state.
+void randstate_clear(randstate_t *rs) {
+    memset(rs, 0, sizeof(*rs));
 }
@@ -2,9 +2,28 @@
 
 #include <stdint.h>
 #include <gmp.h>
+#include "chacha.h"
 
-extern gmp_randstate_t state;
+//A counter-based random state: the ChaCha20 keystream of one (key, stream) pair.
+//States split from the same parent are independent streams of the same seed.
+typedef struct {
+    uint32_t key[CHACHA_KEY_WORDS];
+    uint64_t stream;
+    uint64_t counter;
+    uint32_t block[CHACHA_BLOCK_WORDS];
+    uint32_t used;
+} randstate_t;
 
-void randstate_init(uint64_t seed);
+void randstate_init(randstate_t *rs, uint64_t seed);
 
-void randstate_clear(void);
+void randstate_split(randstate_t *child, const randstate_t *parent, uint64_t index);
+
+void randstate_jump(randstate_t *rs, uint64_t blocks);
+
+uint64_t randstate_u64(randstate_t *rs);
+
+void randstate_urandomb(mpz_t r, randstate_t *rs, uint64_t bits);
+
+void randstate_urandomm(mpz_t r, randstate_t *rs, mpz_t n);
+
+void randstate_clear(randstate_t *rs);
@@ -7,7 +7,17 @@
 #include "numtheory.h"
 #include <inttypes.h>
 #include "rsa.h"
+#include "sha256.h"
+#include "lz.h"
+#include "hex.h"
+#include "arena.h"
+#include "chacha.h"
+#include "checkpoint.h"
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 //Calculates the lcm of p and q.
 //Returns nothing (void).
@@ -17,6 +27,7 @@
 //out: an mpz_t variable that stores the lcm of p and q.
 void lcm(mpz_t out, mpz_t p, mpz_t q) {
     //Initializing and declaring mpz_t variables
+    arena_mark_t mark = arena_begin();
     mpz_t temp, temp2;
     mpz_inits(temp, temp2, NULL);
     //temp = p * q
@@ -24,10 +35,13 @@ void lcm(mpz_t out, mpz_t p, mpz_t q) {
     // temp = |temp|
     mpz_abs(temp, temp);
     gcd(temp2, p, q);
-    //out = temp/temp2
+    //out = temp/temp2, outside the arena since out outlives the scope
+    arena_pause();
     mpz_fdiv_q(out, temp, temp2);
+    arena_resume();
     //clear mpz_t variables
     mpz_clears(temp, temp2, NULL);
+    arena_end(mark);
 }
 
 //Creates an RSA public key, storing the values of p, q, n, and e.
@@ -39,7 +53,8 @@ void lcm(mpz_t out, mpz_t p, mpz_t q) {
 //e: an initialized mpz_t variable that will store the value of the public exponent.
 //nbits: a uint64_t that specifies minimum amount of bits that n should be.
 //iters: a uint64_t that stores the number of is_prime() iterations.
-void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits, uint64_t iters) {
+//rs: random state that p, q, e and the split of bits are drawn from.
+void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits, uint64_t iters, randstate_t *rs) {
     //Initializing and delaring mpz_t variables
     mpz_t p2, q2, lcm_out, lcm_out_copy, e_copy, temp;
     mpz_inits(p2, q2, lcm_out, lcm_out_copy, e_copy, temp, NULL);
@@ -49,14 +64,14 @@ void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits, uint64_t i
     uint64_t qbits;
 
     //calculating an pbits value in range [nbits/4,3*nbits/4], and qbits is nbits - pbits
-    pbits = (random() % ((nbits / 2) + 1) + (nbits / 4));
+    pbits = (randstate_u64(rs) % ((nbits / 2) + 1) + (nbits / 4));
     qbits = nbits - pbits;
 
     //Finding a prime number for n.
     do {
 
-        make_prime(p, pbits, iters);
-        make_prime(q, qbits, iters);
+        make_prime(p, pbits, iters, rs);
+        make_prime(q, qbits, iters, rs);
 
         mpz_mul(n, p, q);
 
@@ -71,7 +86,7 @@ void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits, uint64_t i
 
     //Finding a public exponent e.
     do {
-        mpz_urandomb(e, state, nbits);
+        randstate_urandomb(e, rs, nbits);
         mpz_set(e_copy, e);
         gcd(temp, e_copy, lcm_out_copy);
         mpz_set(e_copy, e);
@@ -169,14 +184,25 @@ void rsa_encrypt(mpz_t c, mpz_t m, mpz_t e, mpz_t n) {
     pow_mod(c, m, e, n);
 }
 
-//Encrypts a given text file in blocks.
-//Returns nothing.
+//Writes the end-of-stream line that lets rsa_decrypt_file detect truncated input.
+//Returns false if the write failed.
+//
+//writer: writer of the encrypted blocks.
+//blocks: number of blocks written.
+static bool write_end(hex_writer_t *writer, uint64_t blocks) {
+    char mark[32];
+    snprintf(mark, sizeof(mark), "%c%" PRIx64 "\n", END_MARK, blocks);
+    return hex_write_text(writer, mark);
+}
+
+//Encrypts a given text file in blocks, ending with an end-of-stream line.
+//Returns false if memory ran out or a write failed.
 //
 //infile: file to encrypt.
 //outfile: file to output encrypted text to.
 //n: mpz_t that has stored value of n.
 //e: mpz_t that has stored value of e.
-void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
+bool rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
     //setting k value for number of bytes in a block for encryption.
     uint64_t k = ((mpz_sizeinbase(n, 2)) - 1) / 8;
 
@@ -185,12 +211,22 @@ void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
     block = (uint8_t *) calloc(k, sizeof(uint8_t));
 
     size_t j;
+    uint64_t blocks = 0;
 
     //Declaring and Initializing mpz_t variables
     mpz_t message, ciphertext;
     mpz_inits(message, ciphertext, NULL);
+    //Lines are buffered and written a buffer at a time
+    hex_writer_t writer;
+    bool ok = hex_writer_init(&writer, outfile) && block != NULL;
+    if (!ok) {
+        hex_writer_clear(&writer);
+        mpz_clears(message, ciphertext, NULL);
+        free(block);
+        return false;
+    }
     //prepending block with a value
-    block[0] = 0xFF;
+    block[0] = BLOCK_RAW;
 
     //Encrypting data in blocks
     do {
@@ -208,12 +244,684 @@ void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
         //encrypting the block
         rsa_encrypt(ciphertext, message, e, n);
         //printing the encrypted block value to outfile
-        gmp_fprintf(outfile, "%Zx\n", ciphertext);
-    } while (j == (k - 1));
+        ok = hex_write_mpz(&writer, ciphertext);
+        blocks += 1;
+    } while (ok && j == (k - 1));
+
+    //marking the end of the stream
+    ok = ok && write_end(&writer, blocks);
 
     //clearing mpz_ variables and freeing block memory
+    ok = hex_writer_clear(&writer) && ok;
     mpz_clears(message, ciphertext, NULL);
     free(block);
+    return ok;
+}
+
+//Encrypts a given file in blocks after compressing it, ending with an end-of-stream line.
+//The input is compressed in LZ_CHUNK_BYTES frames, and the frames are encrypted as one
+//byte stream in blocks prefixed with BLOCK_LZ so rsa_decrypt_file knows to decompress.
+//Returns false if memory ran out or a write failed.
+//
+//infile: file to encrypt.
+//outfile: file to output encrypted text to.
+//n: mpz_t that has stored value of n.
+//e: mpz_t that has stored value of e.
+bool rsa_encrypt_file_compressed(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
+    //setting k value for number of bytes in a block for encryption.
+    uint64_t k = ((mpz_sizeinbase(n, 2)) - 1) / 8;
+
+    //dynamically allocating memory for a block, a chunk of input and its frame
+    uint8_t *block = (uint8_t *) calloc(k, sizeof(uint8_t));
+    uint8_t *chunk = (uint8_t *) malloc(LZ_CHUNK_BYTES);
+    uint8_t *frame = (uint8_t *) malloc(LZ_HEADER_BYTES + lz_bound(LZ_CHUNK_BYTES));
+
+    size_t j;
+    uint64_t blocks = 0;
+    size_t fill = 0;
+
+    //Declaring and Initializing mpz_t variables
+    mpz_t message, ciphertext;
+    mpz_inits(message, ciphertext, NULL);
+    //Lines are buffered and written a buffer at a time
+    hex_writer_t writer;
+    bool ok = hex_writer_init(&writer, outfile) && block != NULL && chunk != NULL && frame != NULL;
+    //prepending block with a value
+    if (ok) {
+        block[0] = BLOCK_LZ;
+    }
+
+    //Compressing the input a chunk at a time
+    while (ok && (j = fread(chunk, sizeof(uint8_t), LZ_CHUNK_BYTES, infile)) > 0) {
+        size_t len = lz_frame(frame, chunk, j);
+
+        //Encrypting every full block of frame data
+        for (size_t i = 0; ok && i < len;) {
+            size_t take = (k - 1) - fill;
+            if (take > len - i) {
+                take = len - i;
+            }
+            memcpy(block + 1 + fill, frame + i, take);
+            fill += take;
+            i += take;
+
+            if (fill == k - 1) {
+                mpz_import(message, k, 1, sizeof(uint8_t), 1, 0, block);
+                rsa_encrypt(ciphertext, message, e, n);
+                ok = hex_write_mpz(&writer, ciphertext);
+                blocks += 1;
+                fill = 0;
+            }
+        }
+    }
+
+    //Encrypting the last partial block
+    if (ok && fill > 0) {
+        mpz_import(message, fill + 1, 1, sizeof(uint8_t), 1, 0, block);
+        rsa_encrypt(ciphertext, message, e, n);
+        ok = hex_write_mpz(&writer, ciphertext);
+        blocks += 1;
+    }
+
+    //marking the end of the stream
+    ok = ok && write_end(&writer, blocks);
+
+    //clearing mpz_ variables and freeing memory
+    ok = hex_writer_clear(&writer) && ok;
+    mpz_clears(message, ciphertext, NULL);
+    free(block);
+    free(chunk);
+    free(frame);
+    return ok;
+}
+
+//Bytes in the session key of a multi-recipient stream.
+#define SESSION_KEY_BYTES (4 * CHACHA_KEY_WORDS)
+
+//Payload bytes per line of a multi-recipient stream, a whole number of ChaCha20 blocks.
+#define PAYLOAD_LINE_BYTES 4096
+
+//Digits of the key id on a recipient line.
+#define KEY_ID_DIGITS 16
+
+//Derives the id recipient lines are matched by from the first bytes of SHA-256(n).
+//Returns false if memory could not be allocated.
+//
+//id: stores KEY_ID_DIGITS hex digits and a terminator.
+//n: the modulus of the key.
+static bool key_id(char id[], mpz_t n) {
+    size_t count = (mpz_sizeinbase(n, 2) + 7) / 8;
+    uint8_t *bytes = (uint8_t *) malloc(count);
+    uint8_t digest[SHA256_DIGEST_BYTES];
+    if (bytes == NULL) {
+        return false;
+    }
+
+    mpz_export(bytes, &count, 1, sizeof(uint8_t), 1, 0, n);
+    sha256(digest, bytes, count);
+    hex_encode(id, digest, KEY_ID_DIGITS / 2);
+    id[KEY_ID_DIGITS] = '\0';
+    free(bytes);
+    return true;
+}
+
+//Converts session key bytes to ChaCha20 key words.
+//Returns nothing (void).
+//
+//words: stores CHACHA_KEY_WORDS words.
+//bytes: SESSION_KEY_BYTES bytes, read little-endian.
+static void key_words(uint32_t words[], const uint8_t bytes[]) {
+    for (uint32_t i = 0; i < CHACHA_KEY_WORDS; i += 1) {
+        words[i] = (uint32_t) bytes[4 * i] | ((uint32_t) bytes[4 * i + 1] << 8)
+                   | ((uint32_t) bytes[4 * i + 2] << 16) | ((uint32_t) bytes[4 * i + 3] << 24);
+    }
+}
+
+//Writes the recipient line for one key: the key id, then the session key encrypted
+//in blocks prefixed with BLOCK_KEY, as many as the key size needs.
+//Returns false if a write failed or memory ran out.
+//
+//writer: writer of the stream.
+//n, e: public key of the recipient.
+//session: the SESSION_KEY_BYTES session key.
+static bool write_recipient(hex_writer_t *writer, mpz_t n, mpz_t e, const uint8_t session[]) {
+    uint64_t k = ((mpz_sizeinbase(n, 2)) - 1) / 8;
+    if (k < 2) {
+        return false;
+    }
+    size_t blocks = (SESSION_KEY_BYTES + (k - 2)) / (k - 1);
+    uint8_t *block = (uint8_t *) calloc(k, sizeof(uint8_t));
+    uint8_t *bytes = NULL;
+    size_t cap = 0;
+
+    mpz_t message, ciphertext;
+    mpz_inits(message, ciphertext, NULL);
+    //marker, id, then a space and a number below n for each block
+    size_t size = 3 + KEY_ID_DIGITS + blocks * (2 * k + 5);
+    char *line = (char *) malloc(size);
+    bool ok = block != NULL && line != NULL;
+
+    if (ok) {
+        size_t len = 0;
+        line[len++] = KEY_MARK;
+        ok = key_id(line + len, n);
+        len += KEY_ID_DIGITS;
+        block[0] = BLOCK_KEY;
+        for (size_t i = 0; i < SESSION_KEY_BYTES && ok; i += k - 1) {
+            size_t take = (SESSION_KEY_BYTES - i < k - 1) ? SESSION_KEY_BYTES - i : k - 1;
+            memcpy(block + 1, session + i, take);
+            mpz_import(message, take + 1, 1, sizeof(uint8_t), 1, 0, block);
+            rsa_encrypt(ciphertext, message, e, n);
+            line[len++] = ' ';
+            size_t got = hex_format_mpz(line + len, ciphertext, &bytes, &cap);
+            if (got == 0) {
+                ok = false;
+                break;
+            }
+            //the number's newline is dropped
+            len += got - 1;
+        }
+        if (ok) {
+            line[len++] = '\n';
+            line[len] = '\0';
+            ok = hex_write_text(writer, line);
+        }
+    }
+
+    mpz_clears(message, ciphertext, NULL);
+    free(block);
+    free(bytes);
+    free(line);
+    return ok;
+}
+
+//Encrypted payload of a multi-recipient stream, written a line at a time.
+typedef struct {
+    hex_writer_t *writer;
+    uint32_t key[CHACHA_KEY_WORDS];
+    uint8_t data[PAYLOAD_LINE_BYTES];
+    char text[2 * PAYLOAD_LINE_BYTES + 2];
+    size_t fill;
+    uint64_t lines;
+} payload_t;
+
+//Encrypts the buffered payload bytes and writes them as a line of hex.
+//Returns false if the write failed.
+//
+//payload: the payload being written.
+static bool payload_flush(payload_t *payload) {
+    //every line but the last is full, so line i starts at keystream block i * 64
+    chacha_xor(payload->data, payload->fill, payload->key,
+        payload->lines * (PAYLOAD_LINE_BYTES / (4 * CHACHA_BLOCK_WORDS)), 0);
+    hex_encode(payload->text, payload->data, payload->fill);
+    payload->text[2 * payload->fill] = '\n';
+    payload->text[2 * payload->fill + 1] = '\0';
+    payload->lines += 1;
+    payload->fill = 0;
+    return hex_write_text(payload->writer, payload->text);
+}
+
+//Adds bytes to the payload, writing every line that fills up. Also the sink for
+//compressed frames.
+//Returns false if a write failed.
+//
+//arg: the payload_t being written.
+//data: bytes to add.
+//len: number of bytes.
+static bool payload_write(void *arg, const uint8_t *data, size_t len) {
+    payload_t *payload = (payload_t *) arg;
+    while (len > 0) {
+        size_t take = PAYLOAD_LINE_BYTES - payload->fill;
+        take = (take > len) ? len : take;
+        memcpy(payload->data + payload->fill, data, take);
+        payload->fill += take;
+        data += take;
+        len -= take;
+        if (payload->fill == PAYLOAD_LINE_BYTES && !payload_flush(payload)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Encrypts a file once for several recipients. The data is encrypted with ChaCha20 under
+//a random session key, and only the session key is encrypted with each recipient's RSA
+//key, so the cost grows with the size of the data plus a small amount per recipient.
+//The stream is one recipient line per key (KEY_MARK, key id, encrypted session key),
+//then the payload in hex lines of PAYLOAD_LINE_BYTES bytes, then the end-of-stream line
+//counting the payload lines. The first payload byte is BLOCK_RAW, or BLOCK_LZ if the
+//rest of the payload is compressed frames.
+//Returns false if no session key could be made or a write failed.
+//
+//infile: file to encrypt.
+//outfile: file to output encrypted text to.
+//n, e: arrays with the public key of each recipient.
+//keys: number of recipients.
+//compress: compresses the data before encrypting it.
+bool rsa_encrypt_file_multi(FILE *infile, FILE *outfile, mpz_t n[], mpz_t e[], size_t keys, bool compress) {
+    uint8_t session[SESSION_KEY_BYTES];
+
+    //the session key comes from the system, never from the keygen seed
+    FILE *random = fopen("/dev/urandom", "rb");
+    if (random == NULL || fread(session, sizeof(uint8_t), SESSION_KEY_BYTES, random) != SESSION_KEY_BYTES) {
+        fprintf(stderr, "/dev/urandom: Could not read a session key\n");
+        if (random != NULL) {
+            fclose(random);
+        }
+        return false;
+    }
+    fclose(random);
+
+    payload_t *payload = (payload_t *) calloc(1, sizeof(payload_t));
+    uint8_t *chunk = (uint8_t *) malloc(LZ_CHUNK_BYTES);
+    uint8_t *frame = (uint8_t *) malloc(LZ_HEADER_BYTES + lz_bound(LZ_CHUNK_BYTES));
+    hex_writer_t writer;
+    bool ok = hex_writer_init(&writer, outfile) && payload != NULL && chunk != NULL && frame != NULL;
+
+    for (size_t i = 0; i < keys && ok; i += 1) {
+        ok = write_recipient(&writer, n[i], e[i], session);
+    }
+
+    if (ok) {
+        payload->writer = &writer;
+        key_words(payload->key, session);
+        uint8_t prefix = compress ? BLOCK_LZ : BLOCK_RAW;
+        ok = payload_write(payload, &prefix, 1);
+
+        size_t j;
+        while (ok && (j = fread(chunk, sizeof(uint8_t), LZ_CHUNK_BYTES, infile)) > 0) {
+            ok = compress ? payload_write(payload, frame, lz_frame(frame, chunk, j))
+                          : payload_write(payload, chunk, j);
+        }
+        ok = ok && (payload->fill == 0 || payload_flush(payload));
+        //marking the end of the stream
+        ok = ok && write_end(&writer, payload->lines);
+    }
+
+    ok = hex_writer_clear(&writer) && ok;
+    memset(session, 0, sizeof(session));
+    if (payload != NULL) {
+        memset(payload->key, 0, sizeof(payload->key));
+    }
+    free(payload);
+    free(chunk);
+    free(frame);
+    return ok;
+}
+
+//Blocks encrypted by the worker threads at a time in record mode.
+static uint32_t record_batch = RECORD_BATCH_BLOCKS;
+
+//Sets the number of blocks rsa_encrypt_file_records() encrypts per batch. Larger batches
+//start and join the worker threads less often, smaller ones hold fewer records at once.
+//The output does not depend on it. Meant to be called once at startup.
+//Returns nothing (void).
+//
+//blocks: blocks per batch, or 0 for RECORD_BATCH_BLOCKS.
+void set_record_batch(uint32_t blocks) {
+    record_batch = (blocks == 0) ? RECORD_BATCH_BLOCKS : blocks;
+}
+
+//A batch of records split into blocks, shared by the worker threads.
+typedef struct {
+    mpz_ptr n;
+    mpz_ptr e;
+    uint64_t k;
+    uint8_t *data;
+    size_t fill;
+    size_t data_cap;
+    size_t *start;
+    size_t *len;
+    bool *last;
+    mpz_t *cipher;
+    size_t count;
+    size_t cap;
+    atomic_size_t next;
+} records_t;
+
+//Adds one record to a batch, split into blocks of at most k - 1 bytes.
+//Returns false if memory ran out.
+//
+//batch: the batch being filled.
+//record: bytes of the record, delimiter included.
+//len: number of bytes.
+static bool add_record(records_t *batch, const char *record, size_t len) {
+    if (batch->fill + len > batch->data_cap) {
+        size_t cap = 2 * (batch->fill + len);
+        uint8_t *data = (uint8_t *) realloc(batch->data, cap);
+        if (data == NULL) {
+            return false;
+        }
+        batch->data = data;
+        batch->data_cap = cap;
+    }
+    memcpy(batch->data + batch->fill, record, len);
+
+    for (size_t i = 0; i < len; i += batch->k - 1) {
+        if (batch->count == batch->cap) {
+            size_t cap = 2 * batch->cap;
+            size_t *start = (size_t *) realloc(batch->start, cap * sizeof(size_t));
+            batch->start = (start != NULL) ? start : batch->start;
+            size_t *lens = (size_t *) realloc(batch->len, cap * sizeof(size_t));
+            batch->len = (lens != NULL) ? lens : batch->len;
+            bool *last = (bool *) realloc(batch->last, cap * sizeof(bool));
+            batch->last = (last != NULL) ? last : batch->last;
+            mpz_t *cipher = (mpz_t *) realloc(batch->cipher, cap * sizeof(mpz_t));
+            batch->cipher = (cipher != NULL) ? cipher : batch->cipher;
+            if (start == NULL || lens == NULL || last == NULL || cipher == NULL) {
+                return false;
+            }
+            for (size_t j = batch->cap; j < cap; j += 1) {
+                mpz_init(batch->cipher[j]);
+            }
+            batch->cap = cap;
+        }
+        size_t take = (len - i < batch->k - 1) ? len - i : batch->k - 1;
+        batch->start[batch->count] = batch->fill + i;
+        batch->len[batch->count] = take;
+        batch->last[batch->count] = i + take == len;
+        batch->count += 1;
+    }
+    batch->fill += len;
+    return true;
+}
+
+//Encrypts blocks of a batch until none are left. The last block of each record is
+//prefixed with BLOCK_RECORD, the others with BLOCK_RAW.
+//Returns NULL.
+//
+//arg: pointer to the shared records_t.
+static void *encrypt_records(void *arg) {
+    records_t *batch = (records_t *) arg;
+    uint8_t *block = (uint8_t *) malloc(batch->k);
+    mpz_t message;
+    mpz_init(message);
+
+    size_t i;
+    while (block != NULL && (i = atomic_fetch_add(&batch->next, 1)) < batch->count) {
+        block[0] = batch->last[i] ? BLOCK_RECORD : BLOCK_RAW;
+        memcpy(block + 1, batch->data + batch->start[i], batch->len[i]);
+        mpz_import(message, batch->len[i] + 1, 1, sizeof(uint8_t), 1, 0, block);
+        rsa_encrypt(batch->cipher[i], message, batch->e, batch->n);
+    }
+    mpz_clear(message);
+    free(block);
+    return NULL;
+}
+
+//Encrypts a file of newline-delimited records, each record as its own blocks, so every
+//record can be decrypted and returned on its own. Records are read in batches of about
+//the blocks set by set_record_batch(), and the blocks of a batch are shared out to worker threads.
+//The output is ordinary ciphertext ending with an end-of-stream line.
+//Returns false if memory ran out or a write failed.
+//
+//infile: file of records to encrypt.
+//outfile: file to output encrypted text to.
+//n: mpz_t that has stored value of n.
+//e: mpz_t that has stored value of e.
+//threads: number of threads encrypting blocks at once.
+bool rsa_encrypt_file_records(FILE *infile, FILE *outfile, mpz_t n, mpz_t e, uint32_t threads) {
+    records_t batch = { 0 };
+    threads = (threads < 1) ? 1 : threads;
+    batch.n = n;
+    batch.e = e;
+    batch.k = ((mpz_sizeinbase(n, 2)) - 1) / 8;
+    batch.cap = record_batch;
+    batch.start = (size_t *) malloc(batch.cap * sizeof(size_t));
+    batch.len = (size_t *) malloc(batch.cap * sizeof(size_t));
+    batch.last = (bool *) malloc(batch.cap * sizeof(bool));
+    batch.cipher = (mpz_t *) malloc(batch.cap * sizeof(mpz_t));
+    pthread_t *workers = (pthread_t *) calloc(threads, sizeof(pthread_t));
+
+    hex_writer_t writer;
+    bool ok = hex_writer_init(&writer, outfile) && batch.start != NULL && batch.len != NULL
+              && batch.last != NULL && batch.cipher != NULL && workers != NULL;
+    for (size_t i = 0; batch.cipher != NULL && i < batch.cap; i += 1) {
+        mpz_init(batch.cipher[i]);
+    }
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t got = 1;
+    uint64_t blocks = 0;
+    while (ok && got > 0) {
+        batch.count = 0;
+        batch.fill = 0;
+        while (ok && batch.count < record_batch && (got = getline(&line, &line_cap, infile)) > 0) {
+            ok = add_record(&batch, line, (size_t) got);
+        }
+
+        //the calling thread encrypts too
+        atomic_init(&batch.next, 0);
+        uint32_t started = 0;
+        for (uint32_t i = 1; ok && i < threads && i < batch.count; i += 1) {
+            if (pthread_create(&workers[started], NULL, encrypt_records, &batch) == 0) {
+                started += 1;
+            }
+        }
+        encrypt_records(&batch);
+        for (uint32_t i = 0; i < started; i += 1) {
+            pthread_join(workers[i], NULL);
+        }
+
+        //writing the blocks in input order
+        for (size_t i = 0; ok && i < batch.count; i += 1) {
+            ok = hex_write_mpz(&writer, batch.cipher[i]);
+        }
+        blocks += batch.count;
+    }
+
+    //marking the end of the stream
+    ok = ok && write_end(&writer, blocks);
+    ok = hex_writer_clear(&writer) && ok;
+
+    if (batch.cipher != NULL) {
+        for (size_t i = 0; i < batch.cap; i += 1) {
+            mpz_clear(batch.cipher[i]);
+        }
+    }
+    free(batch.cipher);
+    free(batch.start);
+    free(batch.len);
+    free(batch.last);
+    free(batch.data);
+    free(workers);
+    free(line);
+    return ok;
+}
+
+//Adds a ciphertext line consumed by a checkpointed decrypt to the hash of its input. Lines are
+//hashed as parsed, so the digest does not depend on how the reader buffered them.
+//Returns nothing.
+//
+//in_hash: SHA-256 of the input consumed so far.
+//line: the line, without its newline.
+//len: length of the line.
+static void hash_line(sha256_t *in_hash, const char *line, size_t len) {
+    sha256_update(in_hash, (const uint8_t *) line, len);
+    sha256_update(in_hash, (const uint8_t *) "\n", 1);
+}
+
+//Hashes the input an interrupted run consumed, the way that run hashed it: the plaintext bytes
+//when encrypting, the ciphertext lines when decrypting. The input is read below stdio, from
+//the start, and left for checkpoint_restore to seek.
+//Returns false if the input cannot be read up to the checkpoint.
+//
+//c: the loaded checkpoint.
+//in_hash: initialized SHA-256 context that stores the hash of the input consumed.
+//infile: the input file, which must be seekable.
+static bool hash_input(checkpoint_t *c, sha256_t *in_hash, FILE *infile) {
+    int fd = fileno(infile);
+    if (lseek(fd, 0, SEEK_SET) != 0) {
+        return false;
+    }
+
+    if (strcmp(c->mode, "decrypt") == 0) {
+        hex_reader_t reader;
+        bool ok = hex_reader_init(&reader, infile);
+        char *line;
+        size_t len;
+        while (ok && hex_reader_offset(&reader) < c->in_offset) {
+            ok = hex_read_line(&reader, &line, &len) > 0;
+            if (ok) {
+                hash_line(in_hash, line, len);
+            }
+        }
+        ok = ok && hex_reader_offset(&reader) == c->in_offset;
+        hex_reader_clear(&reader);
+        return ok;
+    }
+
+    uint8_t *buf = (uint8_t *) malloc(HEX_BUFFER_BYTES);
+    uint64_t left = c->in_offset;
+    while (buf != NULL && left > 0) {
+        size_t want = (left < HEX_BUFFER_BYTES) ? (size_t) left : HEX_BUFFER_BYTES;
+        ssize_t got = read(fd, buf, want);
+        if (got <= 0) {
+            break;
+        }
+        sha256_update(in_hash, buf, (size_t) got);
+        left -= (uint64_t) got;
+    }
+    free(buf);
+    return buf != NULL && left == 0;
+}
+
+//Starts a checkpointed run. With resume, the checkpoint of the interrupted run is loaded and
+//both files are moved back to it. Without one, the run starts from the beginning.
+//Returns false if the checkpoint is invalid, is for another run, or does not match the input
+//or the output.
+//
+//ckpt: progress of this run with its mode and key set. Stores the progress to continue from.
+//hash: initialized SHA-256 context that stores the hash of the output kept.
+//in_hash: initialized SHA-256 context that stores the hash of the input consumed.
+//ckptname: checkpoint file.
+//resume: continues from ckptname if it exists.
+//infile: the input file.
+//outfile: the output file.
+static bool start_run(checkpoint_t *ckpt, sha256_t *hash, sha256_t *in_hash, const char *ckptname, bool resume,
+    FILE *infile, FILE *outfile) {
+    checkpoint_t saved;
+    int found = resume ? checkpoint_load(&saved, ckptname) : 0;
+    if (found < 0) {
+        fprintf(stderr, "Error: %s is not a valid checkpoint.\n", ckptname);
+        return false;
+    }
+    if (found == 0) {
+        //nothing to resume, so output left by an earlier run is dropped
+        if (ftruncate(fileno(outfile), 0) != 0) {
+            fprintf(stderr, "Error: the output cannot be truncated.\n");
+            return false;
+        }
+        return true;
+    }
+    if (strcmp(saved.mode, ckpt->mode) != 0 || strcmp(saved.key, ckpt->key) != 0) {
+        fprintf(stderr, "Error: %s is a checkpoint for another key or program.\n", ckptname);
+        return false;
+    }
+
+    //the input must be the one the checkpoint was taken on, before the output is cut back
+    uint8_t digest[SHA256_DIGEST_BYTES];
+    bool same = hash_input(&saved, in_hash, infile);
+    sha256_t copy = *in_hash;
+    sha256_final(&copy, digest);
+    if (!same || memcmp(digest, saved.in_digest, SHA256_DIGEST_BYTES) != 0) {
+        fprintf(stderr, "Error: %s is a checkpoint for another input.\n", ckptname);
+        return false;
+    }
+    if (!checkpoint_restore(&saved, infile, outfile, hash)) {
+        return false;
+    }
+    *ckpt = saved;
+    return true;
+}
+
+//Takes a checkpoint if CHECKPOINT_SECONDS have passed since the last one.
+//Returns false if the checkpoint could not be written.
+//
+//ckpt: progress of the run, up to the last whole block written.
+//hash: SHA-256 of the output so far.
+//in_hash: SHA-256 of the input consumed so far.
+//outfile: the output file.
+//ckptname: checkpoint file.
+//last: time of the last checkpoint, updated when one is taken.
+static bool save_progress(checkpoint_t *ckpt, sha256_t *hash, sha256_t *in_hash, FILE *outfile, const char *ckptname,
+    time_t *last) {
+    time_t now = time(NULL);
+    if (now - *last < CHECKPOINT_SECONDS) {
+        return true;
+    }
+    *last = now;
+    if (!checkpoint_take(ckpt, hash, in_hash, outfile, ckptname)) {
+        fprintf(stderr, "Error: could not write checkpoint %s.\n", ckptname);
+        return false;
+    }
+    return true;
+}
+
+//Encrypts a given file like rsa_encrypt_file, taking a checkpoint every CHECKPOINT_SECONDS so
+//an interrupted run can be resumed without redoing the blocks already written. Each line is
+//written whole and hashed, so the output is valid up to the last checkpoint, and resuming
+//produces the same output as an uninterrupted run. The checkpoint is removed at the end.
+//Returns false if the checkpoint could not be used or a write failed.
+//
+//infile: file to encrypt. It must be seekable to resume.
+//outfile: file to output encrypted text to. It must be open for reading and writing to resume.
+//n: mpz_t that has stored value of n.
+//e: mpz_t that has stored value of e.
+//ckptname: checkpoint file.
+//resume: continues from ckptname if it exists, instead of starting over.
+bool rsa_encrypt_file_checkpoint(FILE *infile, FILE *outfile, mpz_t n, mpz_t e, const char *ckptname, bool resume) {
+    //setting k value for number of bytes in a block for encryption.
+    uint64_t k = ((mpz_sizeinbase(n, 2)) - 1) / 8;
+    uint8_t *block = (uint8_t *) calloc(k, sizeof(uint8_t));
+    char *line = (char *) malloc(hex_line_bytes(n));
+    uint8_t *bytes = NULL;
+    size_t bytes_cap = 0;
+
+    mpz_t message, ciphertext;
+    mpz_inits(message, ciphertext, NULL);
+
+    checkpoint_t ckpt;
+    memset(&ckpt, 0, sizeof(ckpt));
+    strcpy(ckpt.mode, "encrypt");
+    sha256_t hash, in_hash;
+    sha256_init(&hash);
+    sha256_init(&in_hash);
+    bool ok = block != NULL && line != NULL && key_id(ckpt.key, n) && start_run(&ckpt, &hash, &in_hash, ckptname, resume, infile, outfile);
+    time_t last = time(NULL);
+
+    //the input offset is a multiple of k - 1, so the blocks are the ones rsa_encrypt_file makes
+    size_t j = k - 1;
+    while (ok && j == k - 1) {
+        block[0] = BLOCK_RAW;
+        j = fread(block + 1, sizeof(uint8_t), k - 1, infile);
+        if (j == 0) {
+            break;
+        }
+        mpz_import(message, j + 1, 1, sizeof(uint8_t), 1, 0, block);
+        rsa_encrypt(ciphertext, message, e, n);
+        size_t len = hex_format_mpz(line, ciphertext, &bytes, &bytes_cap);
+        ok = len > 0 && fwrite(line, sizeof(char), len, outfile) == len;
+        sha256_update(&hash, (uint8_t *) line, len);
+        sha256_update(&in_hash, block + 1, j);
+        ckpt.in_offset += j;
+        ckpt.blocks += 1;
+        ckpt.out_len += len;
+        ok = ok && save_progress(&ckpt, &hash, &in_hash, outfile, ckptname, &last);
+    }
+
+    //marking the end of the stream, after which the checkpoint is not needed
+    ok = ok && fprintf(outfile, "%c%" PRIx64 "\n", END_MARK, ckpt.blocks) > 0 && fflush(outfile) == 0;
+    if (ok) {
+        remove(ckptname);
+    }
+
+    mpz_clears(message, ciphertext, NULL);
+    free(block);
+    free(line);
+    free(bytes);
+    return ok;
 }
 
 //Decrypts a given ciphertext c, and stores it in m.
@@ -227,42 +935,418 @@ void rsa_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t n) {
     pow_mod(m, c, d, n);
 }
 
-//Decrypts a given encrypted text file in blocks.
-//Returns nothing.
+//Writes decompressed data to a file.
+//Returns true if all of the data was written.
+//
+//arg: the FILE * to write to.
+//data: bytes to write.
+//len: number of bytes in data.
+static bool write_bytes(void *arg, const uint8_t *data, size_t len) {
+    return fwrite(data, sizeof(uint8_t), len, (FILE *) arg) == len;
+}
+
+//Recovers the session key from a recipient line if the line is for the key n.
+//Returns 1 if the session key was recovered, 0 if the line is for another key, -1 if it is corrupt.
+//
+//reader: reader the line came from.
+//line, len: the recipient line, starting with KEY_MARK.
+//id: key id of n.
+//session: stores the SESSION_KEY_BYTES session key.
+//n, d: the private key.
+static int read_recipient(hex_reader_t *reader, char *line, size_t len, const char id[], uint8_t session[], mpz_t n, mpz_t d) {
+    if (len < 1 + KEY_ID_DIGITS || memcmp(line + 1, id, KEY_ID_DIGITS) != 0) {
+        return 0;
+    }
+
+    uint64_t k = ((mpz_sizeinbase(n, 2)) - 1) / 8;
+    uint8_t *block = (uint8_t *) calloc(k + 1, sizeof(uint8_t));
+    mpz_t message, ciphertext;
+    mpz_inits(message, ciphertext, NULL);
+
+    size_t have = 0;
+    size_t pos = 1 + KEY_ID_DIGITS;
+    bool ok = block != NULL;
+    while (ok && pos < len) {
+        //each block is a space and a number
+        size_t start = pos + 1;
+        size_t end = start;
+        while (end < len && line[end] != ' ') {
+            end += 1;
+        }
+        size_t j = 0;
+        ok = line[pos] == ' ' && hex_parse_mpz(reader, ciphertext, line + start, end - start);
+        if (ok) {
+            rsa_decrypt(message, ciphertext, d, n);
+            mpz_export(block, &j, 1, sizeof(uint8_t), 1, 0, message);
+        }
+        ok = ok && j > 0 && block[0] == BLOCK_KEY && have + (j - 1) <= SESSION_KEY_BYTES;
+        if (ok) {
+            memcpy(session + have, block + 1, j - 1);
+            have += j - 1;
+        }
+        pos = end;
+    }
+
+    mpz_clears(message, ciphertext, NULL);
+    free(block);
+    return (ok && have == SESSION_KEY_BYTES) ? 1 : -1;
+}
+
+//Decrypts a given encrypted text file in blocks, in a single pass.
+//The input is never rewound or seeked, so it may be a pipe, FIFO or socket, and only a
+//buffer of it is held at a time. Reading stops at the end-of-stream line.
+//Returns true if the whole stream was decrypted, false if it was truncated or corrupt.
 //
 //infile: encrypted file to decrypt.
 //outfile: given file to print decrypted text to.
 //n: mpz_t that has set value of n.
 //mpz_t that has already set value of private key.
-void rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d) {
+//legacy: also accepts a stream that ends without an end-of-stream line, as encrypt wrote
+//before it had one. Truncation of such a stream cannot be detected.
+bool rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d, bool legacy) {
     //setting k value for number of bytes in a block for encryption
     uint64_t k = ((mpz_sizeinbase(n, 2)) - 1) / 8;
 
-    //dynamically allocating memory for a block of text
+    //dynamically allocating memory for a block of text, with room for a corrupt block
     uint8_t *block;
-    block = (uint8_t *) calloc(k, sizeof(uint8_t));
+    block = (uint8_t *) calloc(k + 1, sizeof(uint8_t));
 
     size_t j;
+    uint64_t blocks = 0;
 
     //Declaring and Initializing mpz_t variables
     mpz_t message, ciphertext;
     mpz_inits(message, ciphertext, NULL);
 
-    //Ensuring file pointer points to the first element in the file
-    rewind(infile);
+    //Compressed blocks are passed through a frame decompressor
+    lz_stream_t lz;
+    bool compressed = false;
+    bool ok = lz_stream_init(&lz);
+
+    //Lines are read and parsed a buffer at a time
+    hex_reader_t reader;
+    ok = hex_reader_init(&reader, infile) && ok;
+    bool ended = false;
+    char *line;
+    size_t len;
+    int got = 0;
+
+    //Multi-recipient streams start with recipient lines, then a ChaCha20 payload
+    bool multi = false;
+    int unwrapped = 0;
+    int prefix = -1;
+    bool partial = false;
+    uint8_t session[SESSION_KEY_BYTES];
+    uint32_t key[CHACHA_KEY_WORDS];
+    uint8_t *payload = (uint8_t *) malloc(PAYLOAD_LINE_BYTES);
+    char id[KEY_ID_DIGITS + 1];
+    ok = payload != NULL && key_id(id, n) && ok;
 
     //Reading text blocks from file while there are more of them, and decrypting them
-    while (gmp_fscanf(infile, "%Zx\n", ciphertext) != EOF) {
+    while (ok && !ended && (got = hex_read_line(&reader, &line, &len)) > 0) {
+        //recipient lines come before any blocks
+        if (line[0] == KEY_MARK && blocks == 0) {
+            multi = true;
+            if (unwrapped == 0) {
+                unwrapped = read_recipient(&reader, line, len, id, session, n, d);
+            }
+            if (unwrapped > 0) {
+                key_words(key, session);
+            }
+            if (unwrapped < 0) {
+                fprintf(stderr, "Error: invalid recipient line.\n");
+                ok = false;
+            }
+            continue;
+        }
+        if (multi && unwrapped == 0) {
+            fprintf(stderr, "Error: the private key is not one of the recipients.\n");
+            ok = false;
+            break;
+        }
+        //the end-of-stream line must count every block
+        if (line[0] == END_MARK) {
+            ok = hex_parse_mpz(&reader, ciphertext, line + 1, len - 1)
+                 && mpz_cmp_ui(ciphertext, blocks) == 0;
+            if (!ok) {
+                fprintf(stderr, "Error: ciphertext blocks are missing.\n");
+            }
+            ended = true;
+            break;
+        }
+        if (multi) {
+            //every payload line but the last is full, so the keystream position follows the count
+            size_t bytes = len / 2;
+            if (partial || len % 2 != 0 || bytes > PAYLOAD_LINE_BYTES || !hex_decode(payload, line, bytes)) {
+                fprintf(stderr, "Error: invalid ciphertext line.\n");
+                ok = false;
+                break;
+            }
+            partial = bytes < PAYLOAD_LINE_BYTES;
+            chacha_xor(payload, bytes, key, blocks * (PAYLOAD_LINE_BYTES / (4 * CHACHA_BLOCK_WORDS)), 0);
+
+            //the first payload byte says if the rest is compressed
+            uint8_t *data = payload;
+            if (prefix < 0 && bytes > 0) {
+                prefix = data[0];
+                compressed = prefix == BLOCK_LZ;
+                data += 1;
+                bytes -= 1;
+            }
+            if (compressed) {
+                ok = lz_stream_write(&lz, data, bytes, write_bytes, outfile);
+            } else {
+                ok = fwrite(data, sizeof(uint8_t), bytes, outfile) == bytes;
+            }
+            if (!ok) {
+                fprintf(stderr, ferror(outfile) ? "Error: the output cannot be written.\n"
+                                                : "Error: corrupt compressed data.\n");
+            }
+            blocks += 1;
+            continue;
+        }
+        if (!hex_parse_mpz(&reader, ciphertext, line, len)) {
+            fprintf(stderr, "Error: invalid ciphertext line.\n");
+            ok = false;
+            break;
+        }
         //decrypting ciphertext
         rsa_decrypt(message, ciphertext, d, n);
         //converting mpz_t variable into block value
         mpz_export(block, &j, 1, sizeof(uint8_t), 1, 0, message);
+        if (j == 0) {
+            fprintf(stderr, "Error: invalid ciphertext block.\n");
+            ok = false;
+            break;
+        }
         //writing decrypted text to outfile
-        fwrite(block + 1, sizeof(uint8_t), j - 1, outfile);
+        if (block[0] == BLOCK_LZ) {
+            compressed = true;
+            ok = lz_stream_write(&lz, block + 1, j - 1, write_bytes, outfile);
+        } else {
+            ok = fwrite(block + 1, sizeof(uint8_t), j - 1, outfile) == j - 1;
+        }
+        if (!ok) {
+            fprintf(stderr, ferror(outfile) ? "Error: the output cannot be written.\n"
+                                            : "Error: corrupt compressed data.\n");
+        }
+        blocks += 1;
+    }
+    if (got < 0) {
+        fprintf(stderr, "Error: ciphertext line too long.\n");
+        ok = false;
+    } else if (ok && !ended && !legacy) {
+        fprintf(stderr, "Error: ciphertext truncated (no end-of-stream line).\n");
+        ok = false;
+    } else if (ok && compressed && !lz_stream_done(&lz)) {
+        fprintf(stderr, "Error: corrupt compressed data.\n");
+        ok = false;
+    }
+    //clearing mpz_t variables, the session key and freeing block
+    memset(session, 0, sizeof(session));
+    memset(key, 0, sizeof(key));
+    free(payload);
+    hex_reader_clear(&reader);
+    lz_stream_clear(&lz);
+    mpz_clears(message, ciphertext, NULL);
+    free(block);
+    return ok;
+}
+
+//Decrypts a given encrypted file like rsa_decrypt_file, taking a checkpoint every
+//CHECKPOINT_SECONDS so an interrupted run can be resumed without redoing the blocks already
+//written. Only ciphertext of plain blocks for one key can be checkpointed, since compressed
+//and multi-recipient streams carry state from one block to the next.
+//The checkpoint is removed once the end-of-stream line is checked.
+//Returns false if the checkpoint could not be used, or the stream was truncated or corrupt.
+//
+//infile: encrypted file to decrypt. It must be seekable to resume.
+//outfile: file to print decrypted text to. It must be open for reading and writing to resume.
+//n: mpz_t that has set value of n.
+//d: mpz_t that has already set value of private key.
+//ckptname: checkpoint file.
+//resume: continues from ckptname if it exists, instead of starting over.
+bool rsa_decrypt_file_checkpoint(FILE *infile, FILE *outfile, mpz_t n, mpz_t d, const char *ckptname, bool resume) {
+    //setting k value for number of bytes in a block, with room for a corrupt block
+    uint64_t k = ((mpz_sizeinbase(n, 2)) - 1) / 8;
+    uint8_t *block = (uint8_t *) calloc(k + 1, sizeof(uint8_t));
+    size_t j;
+
+    mpz_t message, ciphertext;
+    mpz_inits(message, ciphertext, NULL);
+
+    checkpoint_t ckpt;
+    memset(&ckpt, 0, sizeof(ckpt));
+    strcpy(ckpt.mode, "decrypt");
+    sha256_t hash, in_hash;
+    sha256_init(&hash);
+    sha256_init(&in_hash);
+    bool ok = block != NULL && key_id(ckpt.key, n) && start_run(&ckpt, &hash, &in_hash, ckptname, resume, infile, outfile);
+    time_t last = time(NULL);
+
+    //the reader starts where the checkpoint left the input
+    hex_reader_t reader;
+    ok = hex_reader_init(&reader, infile) && ok;
+    uint64_t start = ckpt.in_offset;
+    bool ended = false;
+    char *line;
+    size_t len;
+    int got = 0;
+
+    while (ok && !ended && (got = hex_read_line(&reader, &line, &len)) > 0) {
+        //the end-of-stream line must count every block
+        if (line[0] == END_MARK) {
+            ok = hex_parse_mpz(&reader, ciphertext, line + 1, len - 1) && mpz_cmp_ui(ciphertext, ckpt.blocks) == 0;
+            if (!ok) {
+                fprintf(stderr, "Error: ciphertext blocks are missing.\n");
+            }
+            ended = true;
+            break;
+        }
+        if (line[0] == KEY_MARK) {
+            fprintf(stderr, "Error: ciphertext for several keys cannot be checkpointed.\n");
+            ok = false;
+            break;
+        }
+        if (!hex_parse_mpz(&reader, ciphertext, line, len)) {
+            fprintf(stderr, "Error: invalid ciphertext line.\n");
+            ok = false;
+            break;
+        }
+        hash_line(&in_hash, line, len);
+        rsa_decrypt(message, ciphertext, d, n);
+        mpz_export(block, &j, 1, sizeof(uint8_t), 1, 0, message);
+        if (j == 0) {
+            fprintf(stderr, "Error: invalid ciphertext block.\n");
+            ok = false;
+            break;
+        }
+        if (block[0] == BLOCK_LZ) {
+            fprintf(stderr, "Error: compressed ciphertext cannot be checkpointed.\n");
+            ok = false;
+            break;
+        }
+        ok = fwrite(block + 1, sizeof(uint8_t), j - 1, outfile) == j - 1;
+        sha256_update(&hash, block + 1, j - 1);
+        ckpt.in_offset = start + hex_reader_offset(&reader);
+        ckpt.blocks += 1;
+        ckpt.out_len += j - 1;
+        ok = ok && save_progress(&ckpt, &hash, &in_hash, outfile, ckptname, &last);
     }
-    //clearing mpz_t variables and freeing block
+    if (got < 0) {
+        fprintf(stderr, "Error: ciphertext line too long.\n");
+        ok = false;
+    } else if (ok && !ended) {
+        fprintf(stderr, "Error: ciphertext truncated (no end-of-stream line).\n");
+        ok = false;
+    }
+    ok = ok && fflush(outfile) == 0;
+    if (ok) {
+        remove(ckptname);
+    }
+
+    hex_reader_clear(&reader);
     mpz_clears(message, ciphertext, NULL);
     free(block);
+    return ok;
+}
+
+//Initializes a reader that decrypts a record stream one record at a time.
+//Returns false if memory could not be allocated.
+//
+//r: the reader to initialize.
+//infile: encrypted file to decrypt, read in a single pass.
+//n: mpz_t that has set value of n. It must stay set until the reader is cleared.
+//d: mpz_t that has already set value of private key. It must stay set until the reader is cleared.
+bool rsa_record_reader_init(rsa_record_reader_t *r, FILE *infile, mpz_t n, mpz_t d) {
+    r->n = n;
+    r->d = d;
+    r->k = ((mpz_sizeinbase(n, 2)) - 1) / 8;
+    r->block = (uint8_t *) calloc(r->k + 1, sizeof(uint8_t));
+    r->record = NULL;
+    r->len = 0;
+    r->cap = 0;
+    r->blocks = 0;
+    r->ended = false;
+    mpz_inits(r->message, r->ciphertext, NULL);
+    return hex_reader_init(&r->reader, infile) && r->block != NULL;
+}
+
+//Decrypts the next record of a stream written by rsa_encrypt_file_records(). Only the
+//blocks of that record are read. Data after the last BLOCK_RECORD block is returned as
+//a last record, so ordinary ciphertext reads as a single record.
+//Returns 1 if a record was read, 0 at the end of the stream, -1 if the stream is truncated or corrupt.
+//
+//r: an initialized reader.
+//record: set to the bytes of the record, valid until the next call.
+//len: set to the number of bytes, delimiter included.
+int rsa_read_record(rsa_record_reader_t *r, uint8_t **record, size_t *len) {
+    char *line;
+    size_t size;
+    int got = 0;
+
+    r->len = 0;
+    while (!r->ended && (got = hex_read_line(&r->reader, &line, &size)) > 0) {
+        //the end-of-stream line must count every block
+        if (line[0] == END_MARK) {
+            r->ended = true;
+            if (!hex_parse_mpz(&r->reader, r->ciphertext, line + 1, size - 1)
+                || mpz_cmp_ui(r->ciphertext, r->blocks) != 0) {
+                fprintf(stderr, "Error: ciphertext blocks are missing.\n");
+                return -1;
+            }
+            break;
+        }
+        if (!hex_parse_mpz(&r->reader, r->ciphertext, line, size)) {
+            fprintf(stderr, "Error: invalid ciphertext line.\n");
+            return -1;
+        }
+        //decrypting ciphertext and converting it into block value
+        size_t j;
+        rsa_decrypt(r->message, r->ciphertext, r->d, r->n);
+        mpz_export(r->block, &j, 1, sizeof(uint8_t), 1, 0, r->message);
+        if (j == 0 || (r->block[0] != BLOCK_RAW && r->block[0] != BLOCK_RECORD)) {
+            fprintf(stderr, "Error: invalid ciphertext block.\n");
+            return -1;
+        }
+        r->blocks += 1;
+
+        if (r->len + j - 1 > r->cap) {
+            size_t cap = 2 * (r->len + j);
+            uint8_t *grown = (uint8_t *) realloc(r->record, cap);
+            if (grown == NULL) {
+                return -1;
+            }
+            r->record = grown;
+            r->cap = cap;
+        }
+        memcpy(r->record + r->len, r->block + 1, j - 1);
+        r->len += j - 1;
+        if (r->block[0] == BLOCK_RECORD) {
+            *record = r->record;
+            *len = r->len;
+            return 1;
+        }
+    }
+    if (!r->ended) {
+        fprintf(stderr, (got < 0) ? "Error: ciphertext line too long.\n"
+                                  : "Error: ciphertext truncated (no end-of-stream line).\n");
+        return -1;
+    }
+    *record = r->record;
+    *len = r->len;
+    return (r->len > 0) ? 1 : 0;
+}
+
+//Frees the memory of a record reader. The file is not closed.
+//Returns nothing (void).
+//
+//r: an initialized reader.
+void rsa_record_reader_clear(rsa_record_reader_t *r) {
+    hex_reader_clear(&r->reader);
+    mpz_clears(r->message, r->ciphertext, NULL);
+    free(r->block);
+    free(r->record);
 }
 
 //Signs RSA, by producing a signature
@@ -279,6 +1363,7 @@ void rsa_sign(mpz_t s, mpz_t m, mpz_t d, mpz_t n) {
 //m: an mpz_t that stores the actual value of the signature
 //s, e, and n are mpz_t variables that have already been set.
 bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n) {
+    arena_mark_t mark = arena_begin();
     mpz_t t;
     mpz_init(t);
 
@@ -287,10 +1372,68 @@ bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n) {
     if (mpz_cmp(m, t) == 0) {
         //signature is verified.
         mpz_clear(t);
+        arena_end(mark);
         return true;
     } else {
         //signature could not be verified.
         mpz_clear(t);
+        arena_end(mark);
         return false;
     }
 }
+
+//Converts the tree hash of a file into a message value below n.
+//Returns true if the file was hashed, false if it could not be read.
+//
+//m: initialized mpz_t that stores the digest reduced (mod n).
+//infile: file to hash from its current position to EOF.
+//n: mpz_t that has stored value of n.
+//threads: number of threads used to hash the file.
+static bool digest_file(mpz_t m, FILE *infile, mpz_t n, uint32_t threads) {
+    uint8_t digest[SHA256_DIGEST_BYTES];
+
+    if (!tree_hash_file(infile, digest, threads)) {
+        return false;
+    }
+    mpz_import(m, SHA256_DIGEST_BYTES, 1, sizeof(uint8_t), 1, 0, digest);
+    mpz_mod(m, m, n);
+    return true;
+}
+
+//Signs the contents of a file. Only the hash grows with the file size,
+//the RSA operation is done once on the digest.
+//Returns true if the file was signed, false if it could not be read.
+//
+//s: initialized mpz_t that stores the signature.
+//infile: file to sign.
+//n: mpz_t that has stored value of n.
+//d: mpz_t that has already set value of private key.
+//threads: number of threads used to hash the file.
+bool rsa_sign_file(mpz_t s, FILE *infile, mpz_t n, mpz_t d, uint32_t threads) {
+    mpz_t m;
+    mpz_init(m);
+
+    bool ok = digest_file(m, infile, n, threads);
+    if (ok) {
+        rsa_sign(s, m, d, n);
+    }
+    mpz_clear(m);
+    return ok;
+}
+
+//Verifies the signature of a file.
+//Returns true if the signature matches the file, else returns false.
+//
+//s: mpz_t that has stored value of the signature.
+//infile: file to verify.
+//e: mpz_t that has stored value of e.
+//n: mpz_t that has stored value of n.
+//threads: number of threads used to hash the file.
+bool rsa_verify_file(mpz_t s, FILE *infile, mpz_t e, mpz_t n, uint32_t threads) {
+    mpz_t m;
+    mpz_init(m);
+
+    bool ok = digest_file(m, infile, n, threads) && rsa_verify(m, s, e, n);
+    mpz_clear(m);
+    return ok;
+}
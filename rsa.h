@@ -4,8 +4,41 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <gmp.h>
+#include "randstate.h"
+#include "hex.h"
 
-void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits, uint64_t iters);
+//Prefix byte of blocks holding plain input.
+#define BLOCK_RAW 0xFF
+//Prefix byte of blocks holding compressed frames.
+#define BLOCK_LZ 0xFE
+//Prefix byte of blocks holding part of a session key.
+#define BLOCK_KEY 0xFD
+//Prefix byte of the last block of a record.
+#define BLOCK_RECORD 0xFC
+//First character of the end-of-stream line, which is followed by the block count in hex.
+#define END_MARK '.'
+//First character of a recipient line of a multi-recipient stream.
+#define KEY_MARK '*'
+//Blocks encrypted at a time in record mode when no profile sets another count.
+#define RECORD_BATCH_BLOCKS 4096
+
+//Decrypts a record stream one record at a time.
+typedef struct {
+    hex_reader_t reader;
+    mpz_ptr n;
+    mpz_ptr d;
+    uint64_t k;
+    mpz_t message;
+    mpz_t ciphertext;
+    uint8_t *block;
+    uint8_t *record;
+    size_t len;
+    size_t cap;
+    uint64_t blocks;
+    bool ended;
+} rsa_record_reader_t;
+
+void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits, uint64_t iters, randstate_t *rs);
 
 void rsa_write_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile);
 
@@ -19,12 +52,34 @@ void rsa_read_priv(mpz_t n, mpz_t d, FILE *pvfile);
 
 void rsa_encrypt(mpz_t c, mpz_t m, mpz_t e, mpz_t n);
 
-void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e);
+bool rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e);
+
+bool rsa_encrypt_file_compressed(FILE *infile, FILE *outfile, mpz_t n, mpz_t e);
+
+bool rsa_encrypt_file_multi(FILE *infile, FILE *outfile, mpz_t n[], mpz_t e[], size_t keys, bool compress);
+
+void set_record_batch(uint32_t blocks);
+
+bool rsa_encrypt_file_records(FILE *infile, FILE *outfile, mpz_t n, mpz_t e, uint32_t threads);
+
+bool rsa_encrypt_file_checkpoint(FILE *infile, FILE *outfile, mpz_t n, mpz_t e, const char *ckptname, bool resume);
 
 void rsa_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t n);
 
-void rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d);
+bool rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d, bool legacy);
+
+bool rsa_decrypt_file_checkpoint(FILE *infile, FILE *outfile, mpz_t n, mpz_t d, const char *ckptname, bool resume);
+
+bool rsa_record_reader_init(rsa_record_reader_t *r, FILE *infile, mpz_t n, mpz_t d);
+
+int rsa_read_record(rsa_record_reader_t *r, uint8_t **record, size_t *len);
+
+void rsa_record_reader_clear(rsa_record_reader_t *r);
 
 void rsa_sign(mpz_t s, mpz_t m, mpz_t d, mpz_t n);
 
 bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n);
+
+bool rsa_sign_file(mpz_t s, FILE *infile, mpz_t n, mpz_t d, uint32_t threads);
+
+bool rsa_verify_file(mpz_t s, FILE *infile, mpz_t e, mpz_t n, uint32_t threads);
@@ -0,0 +1,277 @@
+#include "sha256.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+//SHA-256 as specified in FIPS 180-4.
+
+//Round constants.
+static const uint32_t K[64] = { 0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+    0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74,
+    0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+    0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3,
+    0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354,
+    0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+    0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3,
+    0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa,
+    0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+//Processes one 64 byte block of input into the hash state.
+//Returns nothing (void).
+//
+//h: the eight word hash state.
+//block: 64 bytes of input.
+static void sha256_compress(uint32_t h[], const uint8_t block[]) {
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, hh;
+
+    for (uint32_t i = 0; i < 16; i += 1) {
+        w[i] = ((uint32_t) block[4 * i] << 24) | ((uint32_t) block[4 * i + 1] << 16)
+               | ((uint32_t) block[4 * i + 2] << 8) | (uint32_t) block[4 * i + 3];
+    }
+    for (uint32_t i = 16; i < 64; i += 1) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = h[0];
+    b = h[1];
+    c = h[2];
+    d = h[3];
+    e = h[4];
+    f = h[5];
+    g = h[6];
+    hh = h[7];
+
+    for (uint32_t i = 0; i < 64; i += 1) {
+        uint32_t s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = hh + s1 + ch + K[i] + w[i];
+        uint32_t s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+
+        hh = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += hh;
+}
+
+//Initializes a SHA-256 context.
+//Returns nothing (void).
+//
+//ctx: the context to initialize.
+void sha256_init(sha256_t *ctx) {
+    static const uint32_t iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f,
+        0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+    memcpy(ctx->h, iv, sizeof(iv));
+    ctx->length = 0;
+    ctx->fill = 0;
+}
+
+//Adds len bytes of data to the hash.
+//Returns nothing (void).
+//
+//ctx: an initialized context.
+//data: bytes to hash.
+//len: number of bytes in data.
+void sha256_update(sha256_t *ctx, const uint8_t *data, size_t len) {
+    ctx->length += len;
+
+    //topping up a partially filled buffer first
+    if (ctx->fill > 0) {
+        size_t take = SHA256_BLOCK_BYTES - ctx->fill;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(ctx->buffer + ctx->fill, data, take);
+        ctx->fill += take;
+        data += take;
+        len -= take;
+        if (ctx->fill < SHA256_BLOCK_BYTES) {
+            return;
+        }
+        sha256_compress(ctx->h, ctx->buffer);
+        ctx->fill = 0;
+    }
+
+    //whole blocks are hashed straight from data
+    while (len >= SHA256_BLOCK_BYTES) {
+        sha256_compress(ctx->h, data);
+        data += SHA256_BLOCK_BYTES;
+        len -= SHA256_BLOCK_BYTES;
+    }
+
+    memcpy(ctx->buffer, data, len);
+    ctx->fill = len;
+}
+
+//Pads the message and writes the 32 byte digest.
+//Returns nothing (void).
+//
+//ctx: an initialized context. It must be re-initialized before reuse.
+//digest: array of at least SHA256_DIGEST_BYTES bytes.
+void sha256_final(sha256_t *ctx, uint8_t digest[]) {
+    uint64_t bits = ctx->length * 8;
+
+    ctx->buffer[ctx->fill] = 0x80;
+    ctx->fill += 1;
+    if (ctx->fill > SHA256_BLOCK_BYTES - 8) {
+        memset(ctx->buffer + ctx->fill, 0, SHA256_BLOCK_BYTES - ctx->fill);
+        sha256_compress(ctx->h, ctx->buffer);
+        ctx->fill = 0;
+    }
+    memset(ctx->buffer + ctx->fill, 0, SHA256_BLOCK_BYTES - 8 - ctx->fill);
+    for (uint32_t i = 0; i < 8; i += 1) {
+        ctx->buffer[SHA256_BLOCK_BYTES - 1 - i] = (uint8_t) (bits >> (8 * i));
+    }
+    sha256_compress(ctx->h, ctx->buffer);
+
+    for (uint32_t i = 0; i < 8; i += 1) {
+        digest[4 * i] = (uint8_t) (ctx->h[i] >> 24);
+        digest[4 * i + 1] = (uint8_t) (ctx->h[i] >> 16);
+        digest[4 * i + 2] = (uint8_t) (ctx->h[i] >> 8);
+        digest[4 * i + 3] = (uint8_t) ctx->h[i];
+    }
+}
+
+//Hashes a single buffer.
+//Returns nothing (void).
+//
+//digest: array of at least SHA256_DIGEST_BYTES bytes.
+//data: bytes to hash.
+//len: number of bytes in data.
+void sha256(uint8_t digest[], const uint8_t *data, size_t len) {
+    sha256_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+}
+
+//One leaf of the tree hash, handed to a worker thread.
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    uint8_t digest[SHA256_DIGEST_BYTES];
+} leaf_t;
+
+//Hashes a leaf as SHA-256(0x00 || data).
+//Returns NULL.
+//
+//arg: pointer to the leaf_t to hash.
+static void *hash_leaf(void *arg) {
+    leaf_t *leaf = (leaf_t *) arg;
+    uint8_t tag = 0x00;
+    sha256_t ctx;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, &tag, 1);
+    sha256_update(&ctx, leaf->data, leaf->len);
+    sha256_final(&ctx, leaf->digest);
+    return NULL;
+}
+
+//Hashes a stream with a two level tree hash so that leaves can be hashed in parallel.
+//The input is split into TREE_LEAF_BYTES leaves, each hashed as SHA-256(0x00 || leaf).
+//The digest is SHA-256(0x01 || leaf digests || 64 bit big-endian input length).
+//The result does not depend on the number of threads used.
+//Returns true on success, false if the input could not be read or memory ran out.
+//
+//infile: stream to hash. It is read once from its current position to EOF.
+//digest: array of at least SHA256_DIGEST_BYTES bytes.
+//threads: number of leaves hashed at once (at least 1). Memory use is threads MiB.
+bool tree_hash_file(FILE *infile, uint8_t digest[], uint32_t threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    leaf_t *leaves = (leaf_t *) calloc(threads, sizeof(leaf_t));
+    pthread_t *workers = (pthread_t *) calloc(threads, sizeof(pthread_t));
+    bool ok = (leaves != NULL) && (workers != NULL);
+
+    for (uint32_t i = 0; ok && i < threads; i += 1) {
+        leaves[i].data = (uint8_t *) malloc(TREE_LEAF_BYTES);
+        ok = leaves[i].data != NULL;
+    }
+
+    uint64_t total = 0;
+    uint8_t tag = 0x01;
+    sha256_t root;
+    sha256_init(&root);
+    sha256_update(&root, &tag, 1);
+
+    bool eof = false;
+    while (ok && !eof) {
+        //filling up to one leaf per thread
+        uint32_t count = 0;
+        while (count < threads && !eof) {
+            leaves[count].len = fread(leaves[count].data, sizeof(uint8_t), TREE_LEAF_BYTES, infile);
+            if (leaves[count].len < TREE_LEAF_BYTES) {
+                eof = true;
+            }
+            if (leaves[count].len > 0) {
+                total += leaves[count].len;
+                count += 1;
+            }
+        }
+
+        //hashing the leaves, the last one on this thread
+        uint32_t started = 0;
+        for (uint32_t i = 0; i + 1 < count; i += 1) {
+            if (pthread_create(&workers[i], NULL, hash_leaf, &leaves[i]) != 0) {
+                break;
+            }
+            started += 1;
+        }
+        for (uint32_t i = started; i < count; i += 1) {
+            hash_leaf(&leaves[i]);
+        }
+        for (uint32_t i = 0; i < started; i += 1) {
+            pthread_join(workers[i], NULL);
+        }
+
+        //leaf digests are added to the root in input order
+        for (uint32_t i = 0; i < count; i += 1) {
+            sha256_update(&root, leaves[i].digest, SHA256_DIGEST_BYTES);
+        }
+    }
+
+    if (ferror(infile)) {
+        ok = false;
+    }
+
+    uint8_t length[8];
+    for (uint32_t i = 0; i < 8; i += 1) {
+        length[i] = (uint8_t) (total >> (56 - 8 * i));
+    }
+    sha256_update(&root, length, sizeof(length));
+    sha256_final(&root, digest);
+
+    for (uint32_t i = 0; leaves != NULL && i < threads; i += 1) {
+        free(leaves[i].data);
+    }
+    free(leaves);
+    free(workers);
+    return ok;
+}
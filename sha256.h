@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SHA256_DIGEST_BYTES 32
+#define SHA256_BLOCK_BYTES  64
+
+//Size of one leaf of the tree hash (1 MiB).
+#define TREE_LEAF_BYTES (1 << 20)
+
+typedef struct {
+    uint32_t h[8];
+    uint64_t length;
+    uint8_t buffer[SHA256_BLOCK_BYTES];
+    size_t fill;
+} sha256_t;
+
+void sha256_init(sha256_t *ctx);
+
+void sha256_update(sha256_t *ctx, const uint8_t *data, size_t len);
+
+void sha256_final(sha256_t *ctx, uint8_t digest[]);
+
+void sha256(uint8_t digest[], const uint8_t *data, size_t len);
+
+bool tree_hash_file(FILE *infile, uint8_t digest[], uint32_t threads);
@@ -0,0 +1,119 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <gmp.h>
+#include <stdlib.h>
+#include "numtheory.h"
+#include <inttypes.h>
+#include "rsa.h"
+#include "arena.h"
+#include <unistd.h>
+
+//Prints the usage message and synopsis to standard error.
+//Returns nothing.
+//
+//val: A string denoting the name of the file when called.
+void usage(char *val) {
+    fprintf(stderr, "SYNOPSIS\n");
+    fprintf(stderr, "   Signs a file using an RSA private key.\n");
+    fprintf(stderr, "   Signatures are checked by the verify program.\n\n");
+    fprintf(stderr, "USAGE\n");
+    fprintf(stderr, "   %s [OPTIONS]\n\n", val);
+    fprintf(stderr, "OPTIONS\n"
+                    "   -h              Display program help and usage.\n"
+                    "   -v              Display verbose program output.\n"
+                    "   -i infile       Input file of data to sign (default: stdin).\n"
+                    "   -o sigfile      Output file for the signature (default: stdout).\n"
+                    "   -n pvfile       Private key file (default: rsa.priv).\n"
+                    "   -t threads      Threads used to hash the input (default: online CPUs).\n");
+}
+
+//Parses command-line options, hashes the input file and writes its signature to sigfile.
+//Returns a 0 or 1 depending on succesful exit of program.
+//
+//argc: int that stores number of command-line options passed
+//argv stores command-line options passed
+int main(int argc, char **argv) {
+    int64_t opt;
+
+    //initializes verbose to false
+    bool verbose = false;
+
+    uint32_t threads = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+
+    //opening files
+    FILE *infile = stdin;
+    FILE *sigfile = stdout;
+    FILE *pvfile = NULL;
+    char *pvname = "rsa.priv";
+
+    //Parsing command line options
+    while ((opt = getopt(argc, argv, "i:o:n:t:vh")) != -1) {
+        switch (opt) {
+        case 'i':
+            infile = fopen(optarg, "rb");
+            //if file can't be opened, print to standard error
+            if (infile == NULL) {
+                fprintf(stderr, "%s: No such file or directory\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'o':
+            sigfile = fopen(optarg, "w");
+            //if file can't be opened, print to standard error
+            if (sigfile == NULL) {
+                fprintf(stderr, "%s: No such file or directory\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'n': pvname = optarg; break;
+        case 't': threads = (uint32_t) strtoul(optarg, NULL, 10); break;
+        case 'v': verbose = true; break;
+        case 'h':
+            usage(argv[0]);
+            return EXIT_FAILURE;
+            break;
+        default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    pvfile = fopen(pvname, "r");
+    //if file can't be opened, print to standard error
+    if (pvfile == NULL) {
+        fprintf(stderr, "%s: No such file or directory\n", pvname);
+        return EXIT_FAILURE;
+    }
+
+    //GMP allocates through the arenas from here on
+    arena_install();
+    mpz_t n, d, s;
+    mpz_inits(n, d, s, NULL);
+
+    //read the private key file
+    rsa_read_priv(n, d, pvfile);
+
+    if (verbose) {
+        gmp_printf("n (%zu bits) = %Zd\n", mpz_sizeinbase(n, 2), n);
+        gmp_printf("d (%zu bits) = %Zd\n", mpz_sizeinbase(d, 2), d);
+    }
+
+    int status = EXIT_SUCCESS;
+    if (rsa_sign_file(s, infile, n, d, threads)) {
+        gmp_fprintf(sigfile, "%Zx\n", s);
+    } else {
+        fprintf(stderr, "Error: failed to read input.\n");
+        status = EXIT_FAILURE;
+    }
+
+    //allocation counts go to standard error, away from any output on standard output
+    if (verbose) {
+        arena_print_stats(stderr);
+    }
+
+    //clear mpz_t variables, and close files
+    mpz_clears(n, d, s, NULL);
+    fclose(pvfile);
+    fclose(infile);
+    fclose(sigfile);
+    return status;
+}
@@ -0,0 +1,331 @@
+#include "stream.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <gmp.h>
+#include "numtheory.h"
+#include "rsa.h"
+#include "hex.h"
+#include "lz.h"
+
+//Push-style encryption and decryption for callers that cannot block, such as event loops.
+//Input is given with rsa_stream_update() as it arrives, rsa_stream_step() does the work a
+//bounded number of exponent bits at a time, and output is drained with rsa_stream_read().
+//The output is the same as rsa_encrypt_file() and rsa_decrypt_file() produce.
+
+//Makes room for need more bytes at the end of a buffer that is consumed from the front.
+//Returns a pointer to the free space, or NULL if memory ran out.
+//
+//buf, pos, len, cap: the buffer, its first unconsumed byte, its end and its capacity.
+//need: bytes needed.
+static uint8_t *room(uint8_t **buf, size_t *pos, size_t *len, size_t *cap, size_t need) {
+    if (*pos > 0 && *len + need > *cap) {
+        memmove(*buf, *buf + *pos, *len - *pos);
+        *len -= *pos;
+        *pos = 0;
+    }
+    if (*len + need > *cap) {
+        size_t grown = (*cap == 0) ? HEX_BUFFER_BYTES : *cap;
+        while (grown < *len + need) {
+            grown *= 2;
+        }
+        uint8_t *bigger = (uint8_t *) realloc(*buf, grown);
+        if (bigger == NULL) {
+            return NULL;
+        }
+        *buf = bigger;
+        *cap = grown;
+    }
+    return *buf + *len;
+}
+
+//Adds bytes to the output of a stream. Also the sink of its decompressor.
+//Returns false if memory ran out.
+//
+//arg: the stream.
+//data: bytes to add.
+//len: number of bytes.
+static bool emit(void *arg, const uint8_t *data, size_t len) {
+    rsa_stream_t *st = (rsa_stream_t *) arg;
+    uint8_t *dst = room(&st->out, &st->out_pos, &st->out_len, &st->out_cap, len);
+    if (dst == NULL) {
+        st->error = "out of memory";
+        return false;
+    }
+    memcpy(dst, data, len);
+    st->out_len += len;
+    return true;
+}
+
+//Initializes a stream.
+//Returns false if memory could not be allocated.
+//
+//st: the stream to initialize.
+//mode: RSA_STREAM_ENCRYPT or RSA_STREAM_DECRYPT.
+//n: the modulus. It must stay set until the stream is cleared.
+//key: e to encrypt or d to decrypt. It must stay set until the stream is cleared.
+//Decrypting streams read the output of encrypt with one key, with or without -c.
+bool rsa_stream_init(rsa_stream_t *st, rsa_stream_mode_t mode, mpz_t n, mpz_t key) {
+    memset(st, 0, sizeof(rsa_stream_t));
+    st->mode = mode;
+    st->n = n;
+    st->key = key;
+    //setting k value for number of bytes in a block, with room for a corrupt block
+    st->k = ((mpz_sizeinbase(n, 2)) - 1) / 8;
+    st->block = (uint8_t *) calloc(st->k + 1, sizeof(uint8_t));
+
+    mpz_inits(st->message, st->ciphertext, NULL);
+    pow_step_init(&st->pow);
+
+    bool ok = st->block != NULL;
+    if (mode == RSA_STREAM_DECRYPT) {
+        ok = hex_reader_init(&st->reader, NULL) && ok;
+        ok = lz_stream_init(&st->lz) && ok;
+    }
+    return ok;
+}
+
+//Adds the next bytes of input: plaintext to encrypt, or ciphertext lines to decrypt.
+//No work is done until rsa_stream_step().
+//Returns false if memory ran out or the input was already finished.
+//
+//st: an initialized stream.
+//data: the bytes, split anywhere.
+//len: number of bytes in data.
+bool rsa_stream_update(rsa_stream_t *st, const uint8_t *data, size_t len) {
+    if (st->final) {
+        st->error = "input after the end of the stream";
+        return false;
+    }
+    if (st->mode == RSA_STREAM_DECRYPT) {
+        if (!hex_reader_push(&st->reader, (const char *) data, len)) {
+            st->error = "out of memory";
+            return false;
+        }
+        return true;
+    }
+    uint8_t *dst = room(&st->in, &st->in_pos, &st->in_len, &st->in_cap, len);
+    if (dst == NULL) {
+        st->error = "out of memory";
+        return false;
+    }
+    memcpy(dst, data, len);
+    st->in_len += len;
+    return true;
+}
+
+//Marks the end of the input. rsa_stream_step() then finishes the stream.
+//Returns nothing (void).
+//
+//st: an initialized stream.
+void rsa_stream_final(rsa_stream_t *st) {
+    st->final = true;
+    st->reader.eof = true;
+}
+
+//Loads the next block of plaintext into message, or writes the end-of-stream line
+//once the input is finished.
+//Returns true if a block was loaded.
+//
+//st: an encrypting stream.
+static bool next_plain(rsa_stream_t *st) {
+    size_t avail = st->in_len - st->in_pos;
+    size_t take = (avail >= st->k - 1) ? st->k - 1 : (st->final ? avail : 0);
+
+    if (take == 0) {
+        if (st->final && !st->ended) {
+            //marking the end of the stream
+            char mark[32];
+            int len = snprintf(mark, sizeof(mark), "%c%" PRIx64 "\n", END_MARK, st->blocks);
+            st->ended = emit(st, (const uint8_t *) mark, (size_t) len);
+        }
+        return false;
+    }
+
+    //prepending block with a value, then converting the text to mpz_t value
+    st->block[0] = BLOCK_RAW;
+    memcpy(st->block + 1, st->in + st->in_pos, take);
+    st->in_pos += take;
+    mpz_import(st->message, take + 1, 1, sizeof(uint8_t), 1, 0, st->block);
+    return true;
+}
+
+//Parses the next ciphertext line into ciphertext, checking the end-of-stream line.
+//Streams hold a single key, so ciphertext for several recipients is refused at its first line.
+//Returns true if a block was loaded.
+//
+//st: a decrypting stream.
+static bool next_cipher(rsa_stream_t *st) {
+    char *line;
+    size_t len;
+
+    if (st->ended) {
+        return false;
+    }
+    int got = hex_read_line(&st->reader, &line, &len);
+    if (got < 0) {
+        st->error = "ciphertext line too long";
+        return false;
+    }
+    if (got == 0) {
+        if (st->final) {
+            st->error = "ciphertext truncated (no end-of-stream line)";
+        }
+        return false;
+    }
+
+    //the end-of-stream line must count every block
+    if (line[0] == END_MARK) {
+        if (!hex_parse_mpz(&st->reader, st->ciphertext, line + 1, len - 1)
+            || mpz_cmp_ui(st->ciphertext, st->blocks) != 0) {
+            st->error = "ciphertext blocks are missing";
+        } else if (st->compressed && !lz_stream_done(&st->lz)) {
+            st->error = "corrupt compressed data";
+        }
+        st->ended = true;
+        return false;
+    }
+    if (line[0] == KEY_MARK) {
+        st->error = "ciphertext for several recipients cannot be streamed";
+        return false;
+    }
+    if (!hex_parse_mpz(&st->reader, st->ciphertext, line, len)) {
+        st->error = "invalid ciphertext line";
+        return false;
+    }
+    return true;
+}
+
+//Writes the output of a finished block: a ciphertext line, or the plaintext of the block.
+//Returns false if the block was corrupt or memory ran out.
+//
+//st: a stream whose block result is in ciphertext (encrypting) or message (decrypting).
+static bool finish_block(rsa_stream_t *st) {
+    st->blocks += 1;
+    if (st->mode == RSA_STREAM_ENCRYPT) {
+        uint8_t *dst = room(&st->out, &st->out_pos, &st->out_len, &st->out_cap, hex_line_bytes(st->ciphertext));
+        size_t len = (dst == NULL) ? 0 : hex_format_mpz((char *) dst, st->ciphertext, &st->bytes, &st->bytes_cap);
+        if (len == 0) {
+            st->error = "out of memory";
+            return false;
+        }
+        st->out_len += len;
+        return true;
+    }
+
+    //converting mpz_t variable into block value
+    size_t j;
+    mpz_export(st->block, &j, 1, sizeof(uint8_t), 1, 0, st->message);
+    if (j == 0) {
+        st->error = "invalid ciphertext block";
+        return false;
+    }
+    if (st->block[0] == BLOCK_LZ) {
+        st->compressed = true;
+        if (!lz_stream_write(&st->lz, st->block + 1, j - 1, emit, st)) {
+            st->error = (st->error != NULL) ? st->error : "corrupt compressed data";
+            return false;
+        }
+        return true;
+    }
+    return emit(st, st->block + 1, j - 1);
+}
+
+//Does up to steps exponent bits of work, across as many blocks as that covers.
+//With steps 0 every block that has its input is finished with pow_mod().
+//Returns RSA_STREAM_MORE if the steps ran out with work left, RSA_STREAM_IDLE if
+//more input is needed or the stream is done, and RSA_STREAM_ERROR if the input is
+//corrupt or memory ran out (the reason is in st->error).
+//
+//st: an initialized stream.
+//steps: the most exponent bits to process in this call, or 0 for no limit.
+int rsa_stream_step(rsa_stream_t *st, uint64_t steps) {
+    uint64_t budget = steps;
+    bool encrypt = st->mode == RSA_STREAM_ENCRYPT;
+    mpz_ptr input = encrypt ? st->message : st->ciphertext;
+    mpz_ptr result = encrypt ? st->ciphertext : st->message;
+
+    while (st->error == NULL) {
+        if (st->busy) {
+            if (!pow_step_run(&st->pow, &budget)) {
+                return RSA_STREAM_MORE;
+            }
+            pow_step_result(result, &st->pow);
+            st->busy = false;
+            finish_block(st);
+            continue;
+        }
+        if (steps > 0 && budget == 0) {
+            return RSA_STREAM_MORE;
+        }
+
+        if (!(encrypt ? next_plain(st) : next_cipher(st))) {
+            break;
+        }
+        if (steps == 0) {
+            pow_mod(result, input, st->key, st->n);
+            finish_block(st);
+        } else {
+            pow_step_start(&st->pow, input, st->key, st->n);
+            st->busy = true;
+        }
+    }
+    return (st->error != NULL) ? RSA_STREAM_ERROR : RSA_STREAM_IDLE;
+}
+
+//Counts the output bytes waiting to be read.
+//Returns the number of bytes.
+//
+//st: an initialized stream.
+size_t rsa_stream_pending(rsa_stream_t *st) {
+    return st->out_len - st->out_pos;
+}
+
+//Takes up to len bytes of output.
+//Returns the number of bytes copied to buf.
+//
+//st: an initialized stream.
+//buf: where to copy the output.
+//len: size of buf.
+size_t rsa_stream_read(rsa_stream_t *st, uint8_t *buf, size_t len) {
+    size_t take = rsa_stream_pending(st);
+    if (take > len) {
+        take = len;
+    }
+    memcpy(buf, st->out + st->out_pos, take);
+    st->out_pos += take;
+    if (st->out_pos == st->out_len) {
+        st->out_pos = 0;
+        st->out_len = 0;
+    }
+    return take;
+}
+
+//Checks if all of the output has been produced: the input was finished, every block was
+//processed and the end-of-stream line was written (encrypting) or checked (decrypting).
+//Returns true if the stream is done. Output may still be waiting to be read.
+//
+//st: an initialized stream.
+bool rsa_stream_done(rsa_stream_t *st) {
+    return st->final && st->ended && !st->busy && st->error == NULL;
+}
+
+//Frees the memory of a stream.
+//Returns nothing (void).
+//
+//st: an initialized stream.
+void rsa_stream_clear(rsa_stream_t *st) {
+    if (st->mode == RSA_STREAM_DECRYPT) {
+        hex_reader_clear(&st->reader);
+        lz_stream_clear(&st->lz);
+    }
+    pow_step_clear(&st->pow);
+    mpz_clears(st->message, st->ciphertext, NULL);
+    free(st->block);
+    free(st->in);
+    free(st->out);
+    free(st->bytes);
+}
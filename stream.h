@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <gmp.h>
+#include "numtheory.h"
+#include "hex.h"
+#include "lz.h"
+
+typedef enum { RSA_STREAM_ENCRYPT, RSA_STREAM_DECRYPT } rsa_stream_mode_t;
+
+//Results of rsa_stream_step().
+#define RSA_STREAM_ERROR (-1)
+#define RSA_STREAM_IDLE  0
+#define RSA_STREAM_MORE  1
+
+//Encrypts or decrypts data pushed in pieces, doing a bounded amount of work per call.
+typedef struct {
+    rsa_stream_mode_t mode;
+    mpz_ptr n;
+    mpz_ptr key;
+    uint64_t k;
+    mpz_t message;
+    mpz_t ciphertext;
+    pow_step_t pow;
+    bool busy;
+    uint8_t *block;
+    uint8_t *in;
+    size_t in_pos;
+    size_t in_len;
+    size_t in_cap;
+    hex_reader_t reader;
+    lz_stream_t lz;
+    bool compressed;
+    uint8_t *out;
+    size_t out_pos;
+    size_t out_len;
+    size_t out_cap;
+    uint8_t *bytes;
+    size_t bytes_cap;
+    uint64_t blocks;
+    bool final;
+    bool ended;
+    const char *error;
+} rsa_stream_t;
+
+bool rsa_stream_init(rsa_stream_t *st, rsa_stream_mode_t mode, mpz_t n, mpz_t key);
+
+bool rsa_stream_update(rsa_stream_t *st, const uint8_t *data, size_t len);
+
+void rsa_stream_final(rsa_stream_t *st);
+
+int rsa_stream_step(rsa_stream_t *st, uint64_t steps);
+
+size_t rsa_stream_pending(rsa_stream_t *st);
+
+size_t rsa_stream_read(rsa_stream_t *st, uint8_t *buf, size_t len);
+
+bool rsa_stream_done(rsa_stream_t *st);
+
+void rsa_stream_clear(rsa_stream_t *st);
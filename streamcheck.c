@@ -0,0 +1,231 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <gmp.h>
+#include <unistd.h>
+#include "numtheory.h"
+#include "randstate.h"
+#include "rsa.h"
+#include "stream.h"
+#include "arena.h"
+
+//Most streams run side by side.
+#define STREAMS_MAX 16
+
+//Bytes pushed into a stream before each slice of work, odd so pieces split lines and blocks.
+#define PIECE_BYTES 997
+
+//Prints the usage message and synopsis to standard error.
+//Returns nothing.
+//
+//val: A string denoting the name of the file when called.
+void usage(char *val) {
+    fprintf(stderr, "SYNOPSIS\n");
+    fprintf(stderr, "   Checks the streaming API against encrypt and decrypt. Several streams\n");
+    fprintf(stderr, "   are stepped in turn with the arena allocator installed, the way an\n");
+    fprintf(stderr, "   event loop would run them, and their output is compared with that of\n");
+    fprintf(stderr, "   rsa_encrypt_file() and the original input.\n\n");
+    fprintf(stderr, "USAGE\n");
+    fprintf(stderr, "   %s [OPTIONS]\n\n", val);
+    fprintf(stderr, "OPTIONS\n"
+                    "   -h              Display program help and usage.\n"
+                    "   -v              Display verbose program output.\n"
+                    "   -b bits         Bits in the modulus (default: 1024).\n"
+                    "   -k streams      Streams run side by side (default: 3, at most 16).\n"
+                    "   -m bytes        Bytes of input (default: 20000).\n"
+                    "   -x steps        Exponent bits per slice of work (default: 16).\n"
+                    "   -s seed         Random seed for the key and the input (default: 2022).\n");
+}
+
+//Growable buffer that collects the output of one stream.
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} buffer_t;
+
+//Appends bytes to a buffer.
+//Returns false if there is no memory for them.
+//
+//b: the buffer.
+//data: bytes to append.
+//len: number of bytes.
+bool buffer_add(buffer_t *b, const uint8_t *data, size_t len) {
+    if (b->len + len > b->cap) {
+        size_t cap = (b->cap == 0) ? 4096 : b->cap;
+        while (cap < b->len + len) {
+            cap *= 2;
+        }
+        uint8_t *grown = (uint8_t *) realloc(b->data, cap);
+        if (grown == NULL) {
+            return false;
+        }
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return true;
+}
+
+//Runs several streams over the same input in turn: each gets a piece of the input and one
+//slice of work before the next one does.
+//Returns true if every stream finished and wrote exactly the expected output.
+//
+//mode: RSA_STREAM_ENCRYPT or RSA_STREAM_DECRYPT.
+//n: the modulus.
+//key: e or d.
+//input: the bytes pushed into every stream.
+//expected: the output every stream must produce.
+//streams: number of streams.
+//steps: exponent bits per slice.
+//verbose: prints the number of slices.
+bool run_streams(rsa_stream_mode_t mode, mpz_t n, mpz_t key, buffer_t *input, buffer_t *expected, uint32_t streams,
+    uint64_t steps, bool verbose) {
+    const char *name = (mode == RSA_STREAM_ENCRYPT) ? "encrypt" : "decrypt";
+    rsa_stream_t st[STREAMS_MAX];
+    buffer_t out[STREAMS_MAX];
+    size_t fed[STREAMS_MAX];
+    bool done[STREAMS_MAX];
+    uint8_t buf[4096];
+    bool ok = true;
+
+    for (uint32_t i = 0; i < streams; i += 1) {
+        rsa_stream_init(&st[i], mode, n, key);
+        memset(&out[i], 0, sizeof(buffer_t));
+        fed[i] = 0;
+        done[i] = false;
+    }
+
+    uint64_t slices = 0;
+    uint32_t running = streams;
+    while (ok && running > 0) {
+        for (uint32_t i = 0; ok && i < streams; i += 1) {
+            if (done[i]) {
+                continue;
+            }
+            if (fed[i] < input->len) {
+                size_t take = (input->len - fed[i] < PIECE_BYTES) ? input->len - fed[i] : PIECE_BYTES;
+                rsa_stream_update(&st[i], input->data + fed[i], take);
+                fed[i] += take;
+                if (fed[i] == input->len) {
+                    rsa_stream_final(&st[i]);
+                }
+            }
+
+            int status = rsa_stream_step(&st[i], steps);
+            slices += 1;
+            size_t got;
+            while ((got = rsa_stream_read(&st[i], buf, sizeof(buf))) > 0) {
+                buffer_add(&out[i], buf, got);
+            }
+            if (status == RSA_STREAM_ERROR) {
+                fprintf(stderr, "Error: %s stream %u: %s.\n", name, i, st[i].error);
+                ok = false;
+            } else if (status == RSA_STREAM_IDLE && rsa_stream_done(&st[i])) {
+                done[i] = true;
+                running -= 1;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < streams; i += 1) {
+        if (ok && (out[i].len != expected->len || memcmp(out[i].data, expected->data, expected->len) != 0)) {
+            fprintf(stderr, "Error: %s stream %u wrote %zu bytes that differ from the %zu expected.\n", name, i,
+                out[i].len, expected->len);
+            ok = false;
+        }
+        rsa_stream_clear(&st[i]);
+        free(out[i].data);
+    }
+    if (ok && verbose) {
+        printf("%s: %u streams, %" PRIu64 " slices, %zu bytes each\n", name, streams, slices, expected->len);
+    }
+    return ok;
+}
+
+//Makes a key and an input, encrypts the input with rsa_encrypt_file() and checks that
+//interleaved encrypt and decrypt streams produce the same ciphertext and the input back.
+//Returns 0 if every stream matched, else returns 1.
+//
+//argc: int that stores number of command-line options passed
+//argv stores command-line options passed
+int main(int argc, char **argv) {
+    int64_t opt;
+
+    bool verbose = false;
+    uint64_t bits = 1024;
+    uint32_t streams = 3;
+    size_t bytes = 20000;
+    uint64_t steps = 16;
+    uint64_t seed = 2022;
+
+    //Parsing command line options
+    while ((opt = getopt(argc, argv, "b:k:m:x:s:vh")) != -1) {
+        switch (opt) {
+        case 'b': bits = strtoull(optarg, NULL, 10); break;
+        case 'k': streams = (uint32_t) strtoul(optarg, NULL, 10); break;
+        case 'm': bytes = (size_t) strtoull(optarg, NULL, 10); break;
+        case 'x': steps = strtoull(optarg, NULL, 10); break;
+        case 's': seed = strtoull(optarg, NULL, 10); break;
+        case 'v': verbose = true; break;
+        case 'h':
+            usage(argv[0]);
+            return EXIT_FAILURE;
+            break;
+        default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (streams == 0 || streams > STREAMS_MAX || bits < 64) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    //streams grow their numbers inside arena scopes, as encrypt and decrypt do
+    arena_install();
+
+    randstate_t rs;
+    randstate_init(&rs, seed);
+    mpz_t p, q, n, e, d;
+    mpz_inits(p, q, n, e, d, NULL);
+    rsa_make_pub(p, q, n, e, bits, 50, &rs);
+    rsa_make_priv(d, e, p, q);
+
+    buffer_t plain = { NULL, 0, 0 };
+    buffer_t cipher = { NULL, 0, 0 };
+    for (size_t i = 0; i < bytes; i += 1) {
+        uint8_t byte = (uint8_t) randstate_u64(&rs);
+        buffer_add(&plain, &byte, 1);
+    }
+
+    //the ciphertext of the file API is the reference
+    FILE *infile = tmpfile();
+    FILE *outfile = tmpfile();
+    if (infile == NULL || outfile == NULL) {
+        fprintf(stderr, "Error: temporary files cannot be created.\n");
+        return EXIT_FAILURE;
+    }
+    fwrite(plain.data, sizeof(uint8_t), plain.len, infile);
+    rewind(infile);
+    rsa_encrypt_file(infile, outfile, n, e);
+    rewind(outfile);
+    uint8_t buf[4096];
+    size_t got;
+    while ((got = fread(buf, sizeof(uint8_t), sizeof(buf), outfile)) > 0) {
+        buffer_add(&cipher, buf, got);
+    }
+    fclose(infile);
+    fclose(outfile);
+
+    bool ok = run_streams(RSA_STREAM_ENCRYPT, n, e, &plain, &cipher, streams, steps, verbose);
+    ok = run_streams(RSA_STREAM_DECRYPT, n, d, &cipher, &plain, streams, steps, verbose) && ok;
+
+    free(plain.data);
+    free(cipher.data);
+    mpz_clears(p, q, n, e, d, NULL);
+    randstate_clear(&rs);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
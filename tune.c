@@ -0,0 +1,332 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "randstate.h"
+#include <stdlib.h>
+#include <string.h>
+#include "numtheory.h"
+#include "rsa.h"
+#include <inttypes.h>
+#include "profile.h"
+#include "arena.h"
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+//Key sizes tuned when no -b option is given.
+static const uint64_t default_bits[] = { 512, 1024, 2048, 4096 };
+
+//Largest number of key sizes tuned in one run.
+#define MAX_SIZES 32
+
+//Record batch sizes tried, in blocks.
+static const uint32_t batch_sizes[] = { 256, 1024, 4096, 16384 };
+
+//Batches of a size the record input must hold for that size to be tried.
+#define MIN_BATCHES 4
+
+//Prints the usage message and synopsis to standard error.
+//Returns nothing.
+//
+//val: A string denoting the name of the file when called.
+void usage(char *val) {
+    fprintf(stderr, "SYNOPSIS\n");
+    fprintf(stderr, "   Measures the fastest modular exponentiation and record mode settings on\n");
+    fprintf(stderr, "   this machine and saves them as the tuning profile loaded by keygen,\n");
+    fprintf(stderr, "   encrypt and decrypt.\n\n");
+    fprintf(stderr, "USAGE\n");
+    fprintf(stderr, "   %s [OPTIONS]\n\n", val);
+    fprintf(stderr, "OPTIONS\n"
+                    "   -h              Display program help and usage.\n"
+                    "   -v              Display verbose program output.\n"
+                    "   -b bits         Key size to tune, may be repeated (default: 512 1024 2048 4096).\n"
+                    "   -o profile      Profile file to write (default: $RSA_TUNE or rsa.tune).\n"
+                    "   -m ms           Milliseconds spent measuring each setting (default: 100).\n");
+}
+
+//Reads a monotonic clock.
+//Returns the time in seconds.
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+//Operands of one exponentiation benchmark, shared by the benchmark threads.
+typedef struct {
+    mpz_ptr base;
+    mpz_ptr exponent;
+    mpz_ptr modulus;
+    double seconds;
+    uint64_t count;
+} bench_t;
+
+//Runs pow_mod() with the current settings for the given time.
+//Returns NULL. The number of calls made is stored in count.
+//
+//arg: pointer to a bench_t.
+void *bench_pow_mod(void *arg) {
+    bench_t *bench = (bench_t *) arg;
+    mpz_t out;
+    mpz_init(out);
+
+    double start = now();
+    bench->count = 0;
+    do {
+        pow_mod(out, bench->base, bench->exponent, bench->modulus);
+        bench->count += 1;
+    } while (now() - start < bench->seconds);
+
+    mpz_clear(out);
+    return NULL;
+}
+
+//Measures pow_mod() throughput with the current settings on a number of threads.
+//Returns the number of calls per second across all threads.
+//
+//bench: operands and measuring time.
+//threads: number of threads running at once.
+double throughput(bench_t *bench, uint32_t threads) {
+    bench_t *runs = (bench_t *) calloc(threads, sizeof(bench_t));
+    pthread_t *workers = (pthread_t *) calloc(threads, sizeof(pthread_t));
+    uint32_t started = 0;
+
+    double start = now();
+    for (uint32_t i = 0; i < threads; i += 1) {
+        runs[i] = *bench;
+    }
+    for (uint32_t i = 1; i < threads; i += 1) {
+        if (pthread_create(&workers[started], NULL, bench_pow_mod, &runs[i]) == 0) {
+            started += 1;
+        }
+    }
+    bench_pow_mod(&runs[0]);
+    for (uint32_t i = 0; i < started; i += 1) {
+        pthread_join(workers[i], NULL);
+    }
+    double elapsed = now() - start;
+
+    uint64_t total = runs[0].count;
+    for (uint32_t i = 0; i < started; i += 1) {
+        total += runs[i + 1].count;
+    }
+    free(runs);
+    free(workers);
+    return (double) total / elapsed;
+}
+
+//Times rsa_encrypt_file_records() on an input with the current settings.
+//Returns the number of records encrypted per second.
+//
+//infile: records to encrypt, rewound before the run.
+//records: number of records in infile.
+//n, e: the key.
+//threads: threads encrypting blocks at once.
+double record_rate(FILE *infile, uint64_t records, mpz_t n, mpz_t e, uint32_t threads) {
+    FILE *outfile = fopen("/dev/null", "w");
+    if (outfile == NULL) {
+        return 0;
+    }
+    rewind(infile);
+    double start = now();
+    rsa_encrypt_file_records(infile, outfile, n, e, threads);
+    double elapsed = now() - start;
+    fclose(outfile);
+    return (double) records / elapsed;
+}
+
+//Finds the record batch size for one key size, with its method and threads already tuned.
+//The input is sized from a first run so each size takes about ten measuring periods.
+//Returns nothing (void).
+//
+//profile: stores the batch size found. Its other settings must already be set.
+//modulus: an odd modulus of the key size.
+//seconds: time spent measuring each setting.
+//verbose: prints every measurement.
+void tune_batch(profile_t *profile, mpz_t modulus, double seconds, bool verbose) {
+    profile->batch = RECORD_BATCH_BLOCKS;
+    FILE *infile = tmpfile();
+    if (infile == NULL) {
+        return;
+    }
+    mpz_t e;
+    mpz_init_set_ui(e, 65537);
+
+    //one block per record, the case where the batch size matters most
+    uint64_t k = ((mpz_sizeinbase(modulus, 2)) - 1) / 8;
+    uint64_t record = (k > 2) ? k - 2 : 1;
+    char *line = (char *) malloc(record + 1);
+    memset(line, 'x', record);
+    line[record] = '\n';
+
+    uint64_t records = batch_sizes[0];
+    for (uint64_t i = 0; i < records; i += 1) {
+        fwrite(line, sizeof(char), record + 1, infile);
+    }
+    set_record_batch(batch_sizes[0]);
+    double rate = record_rate(infile, records, modulus, e, profile->threads);
+    uint64_t wanted = (uint64_t) (rate * seconds * 10);
+    for (; records < wanted && records < MIN_BATCHES * batch_sizes[3]; records += 1) {
+        fwrite(line, sizeof(char), record + 1, infile);
+    }
+
+    //the smallest batch within 5% of the best rate
+    double rates[sizeof(batch_sizes) / sizeof(batch_sizes[0])];
+    double top = 0;
+    size_t tried = 0;
+    for (; tried < sizeof(batch_sizes) / sizeof(batch_sizes[0]); tried += 1) {
+        if (tried > 0 && MIN_BATCHES * batch_sizes[tried] > records) {
+            break;
+        }
+        set_record_batch(batch_sizes[tried]);
+        rates[tried] = record_rate(infile, records, modulus, e, profile->threads);
+        if (verbose) {
+            printf("%" PRIu64 " bits: record batch %" PRIu32 ": %.1f/s\n", profile->bits, batch_sizes[tried],
+                rates[tried]);
+        }
+        top = (rates[tried] > top) ? rates[tried] : top;
+    }
+    for (size_t i = 0; i < tried; i += 1) {
+        if (rates[i] >= 0.95 * top) {
+            profile->batch = batch_sizes[i];
+            break;
+        }
+    }
+    set_record_batch(0);
+
+    free(line);
+    mpz_clear(e);
+    fclose(infile);
+}
+
+//Finds the fastest settings for one key size.
+//Returns nothing (void).
+//
+//profile: stores the settings found. Its bits field must already be set.
+//rs: random state the operands are drawn from.
+//seconds: time spent measuring each setting.
+//verbose: prints every measurement.
+void tune_size(profile_t *profile, randstate_t *rs, double seconds, bool verbose) {
+    mpz_t base, exponent, modulus;
+    mpz_inits(base, exponent, modulus, NULL);
+
+    //an odd modulus of exactly bits bits, and a full size exponent like e and d
+    randstate_urandomb(modulus, rs, profile->bits);
+    mpz_setbit(modulus, profile->bits - 1);
+    mpz_setbit(modulus, 0);
+    randstate_urandomm(base, rs, modulus);
+    randstate_urandomb(exponent, rs, profile->bits);
+
+    bench_t bench = { base, exponent, modulus, seconds, 0 };
+    double best = 0;
+
+    //every method and window size on one thread
+    for (uint32_t m = POW_BINARY; m <= POW_GMP; m += 1) {
+        uint32_t first = (m == POW_WINDOW) ? 2 : 0;
+        uint32_t last = (m == POW_WINDOW) ? POW_WINDOW_MAX : 0;
+        for (uint32_t w = first; w <= last; w += 1) {
+            set_pow_mod((pow_method_t) m, w);
+            double rate = throughput(&bench, 1);
+            if (verbose && m == POW_WINDOW) {
+                printf("%" PRIu64 " bits: window %" PRIu32 ": %.1f/s\n", profile->bits, w, rate);
+            } else if (verbose) {
+                printf("%" PRIu64 " bits: %s: %.1f/s\n", profile->bits,
+                    profile_method_name((pow_method_t) m), rate);
+            }
+            if (rate > best) {
+                best = rate;
+                profile->method = (pow_method_t) m;
+                profile->window = w;
+            }
+        }
+    }
+
+    //the fewest threads within 5% of the best total throughput
+    set_pow_mod(profile->method, profile->window);
+    uint32_t cpus = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t counts[64];
+    double rates[64];
+    double top = 0;
+    uint32_t tried = 0;
+    for (uint32_t t = 1; t < cpus && tried < 63; t *= 2) {
+        counts[tried++] = t;
+    }
+    counts[tried++] = (cpus == 0) ? 1 : cpus;
+    for (uint32_t i = 0; i < tried; i += 1) {
+        rates[i] = throughput(&bench, counts[i]);
+        if (verbose) {
+            printf("%" PRIu64 " bits: %" PRIu32 " threads: %.1f/s\n", profile->bits, counts[i], rates[i]);
+        }
+        top = (rates[i] > top) ? rates[i] : top;
+    }
+    profile->threads = 1;
+    for (uint32_t i = 0; i < tried; i += 1) {
+        if (rates[i] >= 0.95 * top) {
+            profile->threads = counts[i];
+            break;
+        }
+    }
+
+    tune_batch(profile, modulus, seconds, verbose);
+
+    mpz_clears(base, exponent, modulus, NULL);
+}
+
+//Parses command-line options, tunes each key size and writes the profile.
+//Returns a 0 or 1 depending on succesful exit of program.
+//
+//argc: int that stores number of command-line options passed
+//argv stores command-line options passed
+int main(int argc, char **argv) {
+    int64_t opt;
+    bool verbose = false;
+    const char *path = profile_path();
+    double seconds = 0.1;
+
+    profile_t profiles[MAX_SIZES];
+    size_t count = 0;
+
+    //Parsing command line options
+    while ((opt = getopt(argc, argv, "b:o:m:vh")) != -1) {
+        switch (opt) {
+        case 'b':
+            if (count < MAX_SIZES) {
+                profiles[count].bits = (uint64_t) strtoull(optarg, NULL, 10);
+                count += profiles[count].bits >= 16 ? 1 : 0;
+            }
+            break;
+        case 'o': path = optarg; break;
+        case 'm': seconds = strtod(optarg, NULL) / 1000.0; break;
+        case 'v': verbose = true; break;
+        case 'h':
+            usage(argv[0]);
+            return EXIT_FAILURE;
+            break;
+        default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    if (count == 0) {
+        for (; count < sizeof(default_bits) / sizeof(default_bits[0]); count += 1) {
+            profiles[count].bits = default_bits[count];
+        }
+    }
+
+    arena_install();
+    randstate_t rs;
+    randstate_init(&rs, 1);
+    for (size_t i = 0; i < count; i += 1) {
+        tune_size(&profiles[i], &rs, seconds, verbose);
+        printf("%" PRIu64 " bits: %s, window %" PRIu32 ", %" PRIu32 " threads, record batch %" PRIu32 "\n",
+            profiles[i].bits, profile_method_name(profiles[i].method), profiles[i].window, profiles[i].threads,
+            profiles[i].batch);
+    }
+    randstate_clear(&rs);
+
+    if (!profile_save(profiles, count, path)) {
+        fprintf(stderr, "%s: Could not write profile\n", path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <gmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include "numtheory.h"
+#include <inttypes.h>
+#include "rsa.h"
+#include "arena.h"
+#include <unistd.h>
+
+//Prints the usage message and synopsis to standard error.
+//Returns nothing.
+//
+//val: A string denoting the name of the file when called.
+void usage(char *val) {
+    fprintf(stderr, "SYNOPSIS\n");
+    fprintf(stderr, "   Verifies file signatures made by the sign program.\n");
+    fprintf(stderr, "   Files given as operands or in a list file are checked\n");
+    fprintf(stderr, "   against their signature in file.sig using one public key.\n\n");
+    fprintf(stderr, "USAGE\n");
+    fprintf(stderr, "   %s [OPTIONS] [files...]\n\n", val);
+    fprintf(stderr, "OPTIONS\n"
+                    "   -h              Display program help and usage.\n"
+                    "   -v              Display verbose program output.\n"
+                    "   -i infile       Input file of signed data (default: stdin).\n"
+                    "   -s sigfile      Signature of infile (default: infile.sig).\n"
+                    "   -l listfile     File listing one file to verify per line.\n"
+                    "   -n pbfile       Public key file (default: rsa.pub).\n"
+                    "   -t threads      Threads used to hash each file (default: online CPUs).\n");
+}
+
+//Reads a signature written by the sign program.
+//Returns true if a signature was read, else returns false.
+//
+//s: initialized mpz_t that stores the signature.
+//signame: path of the signature file.
+bool read_signature(mpz_t s, char *signame) {
+    FILE *sigfile = fopen(signame, "r");
+    if (sigfile == NULL) {
+        fprintf(stderr, "%s: No such file or directory\n", signame);
+        return false;
+    }
+    bool ok = gmp_fscanf(sigfile, "%Zx", s) == 1;
+    if (!ok) {
+        fprintf(stderr, "%s: Invalid signature file\n", signame);
+    }
+    fclose(sigfile);
+    return ok;
+}
+
+//Verifies one file against its signature and reports the result on stdout.
+//Returns true if the signature matches, else returns false.
+//
+//name: path of the file to verify, or NULL for stdin.
+//signame: path of the signature file, or NULL for name.sig.
+//e, n: public key values already set.
+//threads: number of threads used to hash the file.
+bool verify_one(char *name, char *signame, mpz_t e, mpz_t n, uint32_t threads) {
+    char defname[4096];
+    bool ok = false;
+
+    if (signame == NULL) {
+        if (name == NULL) {
+            fprintf(stderr, "Error: a signature file is needed for stdin.\n");
+            return false;
+        }
+        snprintf(defname, sizeof(defname), "%s.sig", name);
+        signame = defname;
+    }
+
+    mpz_t s;
+    mpz_init(s);
+
+    if (read_signature(s, signame)) {
+        FILE *infile = (name == NULL) ? stdin : fopen(name, "rb");
+        if (infile == NULL) {
+            fprintf(stderr, "%s: No such file or directory\n", name);
+        } else {
+            ok = rsa_verify_file(s, infile, e, n, threads);
+            if (infile != stdin) {
+                fclose(infile);
+            }
+        }
+    }
+    printf("%s: %s\n", (name == NULL) ? "-" : name, ok ? "OK" : "FAILED");
+
+    mpz_clear(s);
+    return ok;
+}
+
+//Parses command-line options, reads the public key once and verifies every given file.
+//Returns a 0 or 1 depending on whether all signatures were verified.
+//
+//argc: int that stores number of command-line options passed
+//argv stores command-line options passed
+int main(int argc, char **argv) {
+    int64_t opt;
+
+    //initializes verbose to false
+    bool verbose = false;
+
+    uint32_t threads = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+
+    char *inname = NULL;
+    char *signame = NULL;
+    char *listname = NULL;
+    char *pbname = "rsa.pub";
+
+    //Parsing command line options
+    while ((opt = getopt(argc, argv, "i:s:l:n:t:vh")) != -1) {
+        switch (opt) {
+        case 'i': inname = optarg; break;
+        case 's': signame = optarg; break;
+        case 'l': listname = optarg; break;
+        case 'n': pbname = optarg; break;
+        case 't': threads = (uint32_t) strtoul(optarg, NULL, 10); break;
+        case 'v': verbose = true; break;
+        case 'h':
+            usage(argv[0]);
+            return EXIT_FAILURE;
+            break;
+        default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    FILE *pbfile = fopen(pbname, "r");
+    //if file can't be opened, print to standard error
+    if (pbfile == NULL) {
+        fprintf(stderr, "%s: No such file or directory\n", pbname);
+        return EXIT_FAILURE;
+    }
+
+    //GMP allocates through the arenas from here on
+    arena_install();
+    mpz_t e, n, user, s;
+    mpz_inits(e, n, user, s, NULL);
+    char username[256] = { 0 };
+
+    //the key is read and checked once for all files
+    rsa_read_pub(n, e, s, username, pbfile);
+    fclose(pbfile);
+
+    if (verbose) {
+        printf("user = %s\n", username);
+        gmp_printf("s (%zu bits) = %Zd\n", mpz_sizeinbase(s, 2), s);
+        gmp_printf("n (%zu bits) = %Zd\n", mpz_sizeinbase(n, 2), n);
+        gmp_printf("e (%zu bits) = %Zd\n", mpz_sizeinbase(e, 2), e);
+    }
+
+    mpz_set_str(user, username, 62);
+
+    if (!rsa_verify(user, s, e, n)) {
+        fprintf(stderr, "Error: invalid key.\n");
+    }
+
+    bool all = true;
+    bool batch = (optind < argc) || (listname != NULL);
+
+    //single file mode
+    if (!batch || inname != NULL) {
+        all = verify_one(inname, signame, e, n, threads) && all;
+    }
+
+    //batch mode: operands first, then the list file
+    for (int i = optind; i < argc; i += 1) {
+        all = verify_one(argv[i], NULL, e, n, threads) && all;
+    }
+    if (listname != NULL) {
+        FILE *listfile = fopen(listname, "r");
+        if (listfile == NULL) {
+            fprintf(stderr, "%s: No such file or directory\n", listname);
+            all = false;
+        } else {
+            char line[4096];
+            while (fgets(line, sizeof(line), listfile) != NULL) {
+                line[strcspn(line, "\r\n")] = '\0';
+                if (line[0] != '\0') {
+                    all = verify_one(line, NULL, e, n, threads) && all;
+                }
+            }
+            fclose(listfile);
+        }
+    }
+
+    //allocation counts go to standard error, away from any output on standard output
+    if (verbose) {
+        arena_print_stats(stderr);
+    }
+
+    //clear mpz_t variables
+    mpz_clears(e, n, user, s, NULL);
+    return all ? EXIT_SUCCESS : EXIT_FAILURE;
+}